@@ -1,781 +1,6903 @@
-// ---------------------- Header Files & Constants ----------------------
-// Includes OpenGL/GLUT libraries for graphics rendering
-// Math library for trigonometric functions (sin, cos, circles)
-// Standard libraries for file I/O, vectors, time functions
-// Defines M_PI constant for mathematical calculations
-
-#include <GL/glut.h>
-#include <cmath>
-#include <cstdlib>
-#include <ctime>
-#include <sstream>
-#include <iostream>
-#include <fstream>
-#include <vector>
-#include <algorithm>
-
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-
-// ---------------------- Game State Management ----------------------
-// Enum defines all possible game screens/states
-// Variables track current state, previous state for resume functionality
-// Window dimensions, score, lives, high score tracking
-// Game time counter and frame counter for animations
-
-enum GameState { MENU, PLAYING, PAUSED, GAMEOVER, WIN, HELP, HIGHSCORE };
-GameState gameState = MENU;
-GameState previousState = MENU;
-
-int windowWidth = 800, windowHeight = 800;
-int score = 0;
-int lives = 3;
-int highScore = 0;
-int gameTime = 0;
-int frameCount = 0;
-
-// ---------------------- Pacman Structure ----------------------
-// Stores Pacman's position (x, y coordinates)
-// Direction vectors (dirX, dirY) for movement
-// Speed value controls how fast Pacman moves per frame
-
-struct Pacman {
-    float x, y;
-    int dirX, dirY;
-    float speed;
-} pacman;
-
-// ---------------------- Ghost Structure & AI ----------------------
-// Each ghost has position, speed, RGB color values
-// Name for identification
-// Behavior type determines AI pattern (chase, ambush, patrol, random)
-// Special timer for behavior timing
-// isActive flag to enable/disable ghost
-
-struct Ghost {
-    float x, y;
-    float speed;
-    float r, g, b;
-    std::string name;
-    int behavior; // 0=chase, 1=ambush, 2=patrol, 3=random
-    float specialTimer;
-    bool isActive;
-};
-
-std::vector<Ghost> ghosts;
-
-// ---------------------- Power-up System ----------------------
-// Power-ups at specific positions with different types
-// Type 0: Invincibility (eat ghosts)
-// Type 1: Freeze (stop ghosts)
-// Type 2: Speed boost
-// Active flag and duration timer for each power-up
-
-struct PowerUp {
-    float x, y;
-    int type; // 0=invincible, 1=freeze, 2=speed
-    bool active;
-    float duration;
-};
-
-std::vector<PowerUp> powerUps;
-float powerUpTimer = 0;
-int activePowerUp = -1;
-
-// ---------------------- Game Board/Grid ----------------------
-// 20x20 grid system for the maze
-// Cell values: 0=empty, 1=pellet, 2=wall, 3=power-up
-// Total pellets counter to check win condition
-
-const int ROWS = 20;
-const int COLS = 20;
-int board[ROWS][COLS];
-int totalPellets = 0;
-
-// ---------------------- Text Rendering Functions ----------------------
-// Draws text at specified coordinates using GLUT bitmap fonts
-// Two sizes: regular (18pt) and small (12pt)
-// Used for menus, score display, instructions
-
-void drawText(float x, float y, const char *text) {
-    glRasterPos2f(x, y);
-    while (*text) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *text);
-        text++;
-    }
-}
-
-void drawTextSmall(float x, float y, const char *text) {
-    glRasterPos2f(x, y);
-    while (*text) {
-        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *text);
-        text++;
-    }
-}
-
-// ---------------------- Utility Function ----------------------
-// Converts integer to string for display purposes
-// Used for score, lives, time display
-
-std::string intToString(int value) {
-    std::ostringstream oss;
-    oss << value;
-    return oss.str();
-}
-
-// ---------------------- High Score Persistence ----------------------
-// Loads high score from file on game start
-// Saves high score to file when game ends if beaten
-// File: "highscore.txt" stores the best score
-
-void loadHighScore() {
-    std::ifstream file("highscore.txt");
-    if (file.is_open()) {
-        file >> highScore;
-        file.close();
-    } else {
-        highScore = 0;
-    }
-}
-
-void saveHighScore() {
-    if (score > highScore) {
-        highScore = score;
-        std::ofstream file("highscore.txt");
-        if (file.is_open()) {
-            file << highScore;
-            file.close();
-        }
-    }
-}
-
-// ---------------------- Board Initialization ----------------------
-// Creates the maze layout with walls around borders
-// Adds internal cross-shaped wall pattern
-// Places pellets in all empty spaces
-// Clears starting positions for Pacman and ghosts
-// Places 4 power-ups in corners
-
-void initBoard() {
-    totalPellets = 0;
-    for (int i = 0; i < ROWS; i++) {
-        for (int j = 0; j < COLS; j++) {
-            if (i == 0 || j == 0 || i == ROWS-1 || j == COLS-1) {
-                board[i][j] = 2; // wall
-            } else if ((i == 10 && j >= 8 && j <= 12) || (j == 10 && i >= 8 && i <= 12)) {
-                board[i][j] = 2; // internal walls
-            } else {
-                board[i][j] = 1; // pellet
-                totalPellets++;
-            }
-        }
-    }
-    // Clear start positions
-    board[1][1] = 0;
-    board[ROWS-2][COLS-2] = 0;
-    board[ROWS-2][1] = 0;
-    board[1][COLS-2] = 0;
-    board[10][10] = 0;
-
-    // Add power-ups
-    board[3][3] = 3;
-    board[3][COLS-4] = 3;
-    board[ROWS-4][3] = 3;
-    board[ROWS-4][COLS-4] = 3;
-}
-
-// ---------------------- Ghost Initialization ----------------------
-// Creates 4 ghosts with unique personalities:
-// Blinky (Red): Aggressive direct chaser, fastest
-// Pinky (Pink): Ambusher, tries to cut you off
-// Inky (Cyan): Uses corner strategy relative to Blinky
-// Clyde (Orange): Random/unpredictable movement, slowest
-// Each starts at different corner position
-
-void initGhosts() {
-    ghosts.clear();
-
-    // Blinky (Red) - Direct chaser
-    Ghost blinky;
-    blinky.x = COLS-2; blinky.y = ROWS-2;
-    blinky.speed = 0.04f;
-    blinky.r = 1.0f; blinky.g = 0.0f; blinky.b = 0.0f;
-    blinky.name = "Blinky";
-    blinky.behavior = 0;
-    blinky.specialTimer = 0;
-    blinky.isActive = true;
-    ghosts.push_back(blinky);
-
-    // Pinky (Pink) - Ambusher
-    Ghost pinky;
-    pinky.x = 1; pinky.y = ROWS-2;
-    pinky.speed = 0.035f;
-    pinky.r = 1.0f; pinky.g = 0.4f; pinky.b = 0.7f;
-    pinky.name = "Pinky";
-    pinky.behavior = 1;
-    pinky.specialTimer = 0;
-    pinky.isActive = true;
-    ghosts.push_back(pinky);
-
-    // Inky (Cyan) - Patrol/Corner
-    Ghost inky;
-    inky.x = COLS-2; inky.y = 1;
-    inky.speed = 0.038f;
-    inky.r = 0.0f; inky.g = 1.0f; inky.b = 1.0f;
-    inky.name = "Inky";
-    inky.behavior = 2;
-    inky.specialTimer = 0;
-    inky.isActive = true;
-    ghosts.push_back(inky);
-
-    // Clyde (Orange) - Random
-    Ghost clyde;
-    clyde.x = 10; clyde.y = 10;
-    clyde.speed = 0.03f;
-    clyde.r = 1.0f; clyde.g = 0.6f; clyde.b = 0.0f;
-    clyde.name = "Clyde";
-    clyde.behavior = 3;
-    clyde.specialTimer = 0;
-    clyde.isActive = true;
-    ghosts.push_back(clyde);
-}
-
-// ---------------------- Power-up Initialization ----------------------
-// Creates 4 power-ups at corner positions
-// Mix of invincibility, freeze, and speed power-ups
-// All start as active and available to collect
-
-void initPowerUps() {
-    powerUps.clear();
-
-    PowerUp p1 = {3, 3, 0, true, 0}; // invincible
-    PowerUp p2 = {COLS-4, 3, 1, true, 0}; // freeze
-    PowerUp p3 = {3, ROWS-4, 2, true, 0}; // speed
-    PowerUp p4 = {COLS-4, ROWS-4, 0, true, 0}; // invincible
-
-    powerUps.push_back(p1);
-    powerUps.push_back(p2);
-    powerUps.push_back(p3);
-    powerUps.push_back(p4);
-}
-
-// ---------------------- Pacman Rendering ----------------------
-// Draws Pacman as a circular shape with mouth opening
-// Uses 36 segments for smooth circle
-// Changes color to cyan when invincible power-up is active
-// Otherwise draws in golden yellow color
-// Mouth angle creates the classic Pacman shape
-
-void drawPacman() {
-    const int SEG = 36;
-    const float radius = 0.5f;
-    const float mouthAngle = 40.0f * M_PI / 180.0f;
-
-    if (activePowerUp == 0) {
-        glColor3f(0.0f, 1.0f, 1.0f); // Cyan when invincible
-    } else {
-        glColor3f(1.0f, 0.84f, 0.0f); // Golden yellow
-    }
-
-    glBegin(GL_TRIANGLE_FAN);
-        glVertex2f(pacman.x + 0.5f, pacman.y + 0.5f);
-        for (int i = 0; i <= SEG; ++i) {
-            float theta = i * 2.0f * (float)M_PI / SEG;
-            if (theta > mouthAngle && theta < (2.0f * M_PI - mouthAngle)) {
-                glVertex2f(pacman.x + 0.5f + radius * std::cos(theta),
-                           pacman.y + 0.5f + radius * std::sin(theta));
-            }
-        }
-    glEnd();
-}
-
-// ---------------------- Ghost Rendering ----------------------
-// Draws each ghost as a circle with two white eyes
-// Ghost color changes to dark blue when frozen (power-up active)
-// Otherwise displays in their unique color (red, pink, cyan, orange)
-// Eyes are two small white circles for visual character
-
-void drawGhost(Ghost &ghost) {
-    const int SEG = 20;
-    const float radius = 0.5f;
-
-    if (activePowerUp == 1) {
-        glColor3f(0.3f, 0.3f, 0.5f); // Darker when frozen
-    } else {
-        glColor3f(ghost.r, ghost.g, ghost.b);
-    }
-
-    glBegin(GL_POLYGON);
-    for (int i = 0; i < SEG; i++) {
-        float theta = i * 2.0f * M_PI / SEG;
-        glVertex2f(ghost.x + 0.5f + radius * std::cos(theta),
-                   ghost.y + 0.5f + radius * std::sin(theta));
-    }
-    glEnd();
-
-    // Eyes
-    glColor3f(1.0f, 1.0f, 1.0f);
-    glBegin(GL_POLYGON);
-    for (int i = 0; i < 10; i++) {
-        float theta = i * 2.0f * M_PI / 10;
-        glVertex2f(ghost.x + 0.3f + 0.15f * std::cos(theta),
-                   ghost.y + 0.7f + 0.15f * std::sin(theta));
-    }
-    glEnd();
-
-    glBegin(GL_POLYGON);
-    for (int i = 0; i < 10; i++) {
-        float theta = i * 2.0f * M_PI / 10;
-        glVertex2f(ghost.x + 0.7f + 0.15f * std::cos(theta),
-                   ghost.y + 0.7f + 0.15f * std::sin(theta));
-    }
-    glEnd();
-}
-
-// ---------------------- Board/Maze Rendering ----------------------
-// Draws all board elements based on grid values:
-// Pellets: Small yellow squares that Pacman collects
-// Walls: Purple rectangles forming the maze
-// Power-ups: Magenta circles at special positions
-// Loops through entire 20x20 grid and draws each cell type
-
-void drawBoard() {
-    for (int i = 0; i < ROWS; i++) {
-        for (int j = 0; j < COLS; j++) {
-            if (board[i][j] == 1) { // pellet
-                glColor3f(1.0f, 0.9f, 0.4f);
-                glBegin(GL_POLYGON);
-                    glVertex2f(j+0.4f, i+0.4f);
-                    glVertex2f(j+0.6f, i+0.4f);
-                    glVertex2f(j+0.6f, i+0.6f);
-                    glVertex2f(j+0.4f, i+0.6f);
-                glEnd();
-            } else if (board[i][j] == 2) { // wall
-                glColor3f(0.2f, 0.0f, 0.6f);
-                glBegin(GL_POLYGON);
-                    glVertex2f(j, i);
-                    glVertex2f(j+1, i);
-                    glVertex2f(j+1, i+1);
-                    glVertex2f(j, i+1);
-                glEnd();
-            } else if (board[i][j] == 3) { // power-up
-                glColor3f(1.0f, 0.0f, 1.0f); // Magenta
-                glBegin(GL_POLYGON);
-                for (int k = 0; k < 20; k++) {
-                    float theta = k * 2.0f * M_PI / 20;
-                    glVertex2f(j + 0.5f + 0.3f * std::cos(theta),
-                               i + 0.5f + 0.3f * std::sin(theta));
-                }
-                glEnd();
-            }
-        }
-    }
-}
-
-// ---------------------- Win Condition Check ----------------------
-// Scans entire board to check if any pellets remain
-// Returns true when all pellets are eaten (win condition)
-// Returns false if any pellet still exists
-
-bool allPelletsEaten() {
-    for (int i = 0; i < ROWS; i++)
-        for (int j = 0; j < COLS; j++)
-            if (board[i][j] == 1) return false;
-    return true;
-}
-
-// ---------------------- Game Reset Function ----------------------
-// Reinitializes all game components to starting state
-// Resets board, ghosts, power-ups
-// Repositions Pacman to starting position (1,1)
-// Resets score, lives, timers
-// Returns to menu screen
-
-void resetGame() {
-    initBoard();
-    initGhosts();
-    initPowerUps();
-    pacman.x = 1; pacman.y = 1; pacman.dirX = 0; pacman.dirY = 0;
-    pacman.speed = 0.1f;
-    score = 0;
-    lives = 3;
-    gameTime = 0;
-    frameCount = 0;
-    powerUpTimer = 0;
-    activePowerUp = -1;
-    gameState = MENU;
-}
-
-// ---------------------- Ghost AI & Movement Logic ----------------------
-// Implements 4 different AI behaviors:
-// Behavior 0 (Blinky): Direct chase - targets Pacman's current position
-// Behavior 1 (Pinky): Ambush - targets 4 cells ahead of Pacman
-// Behavior 2 (Inky): Corner - uses Blinky's position to flank
-// Behavior 3 (Clyde): Random - picks random targets periodically
-// Ghosts freeze when freeze power-up is active
-// Ghost speed gradually increases over time for difficulty
-// Collision detection with walls prevents ghost movement through barriers
-
-void updateGhost(Ghost &ghost) {
-    if (activePowerUp == 1) return; // Frozen
-
-    ghost.specialTimer += 0.016f;
-
-    // Increase speed over time
-    if (gameTime % 30 == 0 && gameTime > 0) {
-        ghost.speed += 0.001f;
-    }
-
-    float targetX = pacman.x;
-    float targetY = pacman.y;
-
-    // Different behaviors
-    if (ghost.behavior == 0) { // Blinky - Direct chase
-        targetX = pacman.x;
-        targetY = pacman.y;
-    } else if (ghost.behavior == 1) { // Pinky - Ambush (ahead of pacman)
-        targetX = pacman.x + pacman.dirX * 4;
-        targetY = pacman.y + pacman.dirY * 4;
-    } else if (ghost.behavior == 2) { // Inky - Try to corner
-        targetX = pacman.x + (pacman.x - ghosts[0].x);
-        targetY = pacman.y + (pacman.y - ghosts[0].y);
-    } else if (ghost.behavior == 3) { // Clyde - Random movement
-        if ((int)ghost.specialTimer % 5 == 0) {
-            targetX = rand() % COLS;
-            targetY = rand() % ROWS;
-        }
-    }
-
-    // Move toward target
-    float dx = targetX - ghost.x;
-    float dy = targetY - ghost.y;
-    float dist = std::sqrt(dx*dx + dy*dy);
-
-    if (dist > 0) {
-        float nextX = ghost.x + (dx/dist) * ghost.speed;
-        float nextY = ghost.y + (dy/dist) * ghost.speed;
-
-        if (board[(int)nextY][(int)nextX] != 2) {
-            ghost.x = nextX;
-            ghost.y = nextY;
-        }
-    }
-}
-
-// ---------------------- Main Game Update Loop ----------------------
-// Only runs when game state is PLAYING
-// Frame counter and time tracking (60 FPS)
-// Pacman movement with wall collision detection
-// Pellet collection and scoring (+10 points per pellet)
-// Power-up collection and activation (+50 points)
-// Power-up timer countdown (5 second duration)
-// Speed boost application/removal for speed power-up
-// Updates all ghost positions using AI
-// Collision detection between Pacman and ghosts:
-//   - With invincibility: Ghost respawns, +100 points
-//   - Without: Lose life, reset positions, check game over
-// Win condition check when all pellets eaten
-
-void updateGame() {
-    if (gameState != PLAYING) return;
-
-    frameCount++;
-    if (frameCount % 60 == 0) {
-        gameTime++;
-    }
-
-    // Move Pacman
-    float nextX = pacman.x + pacman.dirX * pacman.speed;
-    float nextY = pacman.y + pacman.dirY * pacman.speed;
-    if (board[(int)nextY][(int)nextX] != 2) {
-        pacman.x = nextX;
-        pacman.y = nextY;
-    }
-
-    // Eat pellet
-    if (board[(int)pacman.y][(int)pacman.x] == 1) {
-        board[(int)pacman.y][(int)pacman.x] = 0;
-        score += 10;
-    }
-
-    // Collect power-up
-    if (board[(int)pacman.y][(int)pacman.x] == 3) {
-        board[(int)pacman.y][(int)pacman.x] = 0;
-        for (size_t i = 0; i < powerUps.size(); i++) {
-            if ((int)powerUps[i].x == (int)pacman.x && (int)powerUps[i].y == (int)pacman.y && powerUps[i].active) {
-                activePowerUp = powerUps[i].type;
-                powerUpTimer = 5.0f; // 5 seconds
-                powerUps[i].active = false;
-                score += 50;
-
-                if (activePowerUp == 2) {
-                    pacman.speed = 0.15f;
-                }
-                break;
-            }
-        }
-    }
-
-    // Update power-up timer
-    if (powerUpTimer > 0) {
-        powerUpTimer -= 0.016f;
-        if (powerUpTimer <= 0) {
-            activePowerUp = -1;
-            pacman.speed = 0.1f;
-        }
-    }
-
-    // Move Ghosts
-    for (size_t i = 0; i < ghosts.size(); i++) {
-        updateGhost(ghosts[i]);
-    }
-
-    // Collision check
-    for (size_t i = 0; i < ghosts.size(); i++) {
-        if (std::abs(pacman.x - ghosts[i].x) < 0.6 && std::abs(pacman.y - ghosts[i].y) < 0.6) {
-            if (activePowerUp == 0) {
-                // Invincible - ghost respawns
-                ghosts[i].x = 10;
-                ghosts[i].y = 10;
-                score += 100;
-            } else {
-                // Lose life
-                lives--;
-                pacman.x = 1; pacman.y = 1;
-                initGhosts();
-                if (lives <= 0) {
-                    gameState = GAMEOVER;
-                    saveHighScore();
-                }
-            }
-        }
-    }
-
-    // Win check
-    if (allPelletsEaten()) {
-        gameState = WIN;
-        saveHighScore();
-    }
-}
-
-// ---------------------- Display/Rendering Function ----------------------
-// Main rendering function called every frame
-// Sets dark blue background color
-// Renders different screens based on game state:
-// MENU: Title, navigation options (Start, Resume, Help, High Score, Exit)
-// HELP: Complete instructions, controls, ghost behaviors, power-up explanations
-// HIGHSCORE: Displays best score from file
-// PLAYING/PAUSED: Game board, Pacman, ghosts, HUD (score, time, lives)
-//   Shows active power-up name, pause overlay
-// GAMEOVER: Final score, time, menu option
-// WIN: Congratulations, final score, new high score notification
-// Double buffering used for smooth rendering
-
-void display() {
-    glClearColor(0.05f, 0.05f, 0.15f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-
-    glColor3f(0.0f, 1.0f, 1.0f);
-
-    if (gameState == MENU) {
-        drawText(6.5f, 14.0f, "PACMAN GAME");
-        drawText(6.0f, 11.0f, "Press SPACE to Start");
-        drawText(6.5f, 10.0f, "Press R to Resume");
-        drawText(6.5f, 9.0f,  "Press H for Help");
-        drawText(5.5f, 8.0f,  "Press S for High Score");
-        drawText(6.5f, 7.0f,  "Press ESC to Exit");
-    }
-    else if (gameState == HELP) {
-        drawText(7.0f, 16.0f, "HOW TO PLAY");
-        drawTextSmall(3.0f, 14.0f, "CONTROLS:");
-        drawTextSmall(3.0f, 13.0f, "W/A/S/D - Move Up/Left/Down/Right");
-        drawTextSmall(3.0f, 12.0f, "P - Pause, M - Menu, ESC - Exit");
-
-        drawTextSmall(3.0f, 10.5f, "GHOSTS:");
-        drawTextSmall(3.0f, 9.5f, "Blinky (Red) - Chases you directly");
-        drawTextSmall(3.0f, 8.8f, "Pinky (Pink) - Ambushes ahead");
-        drawTextSmall(3.0f, 8.1f, "Inky (Cyan) - Tries to corner you");
-        drawTextSmall(3.0f, 7.4f, "Clyde (Orange) - Random movement");
-
-        drawTextSmall(3.0f, 6.2f, "POWER-UPS (Magenta circles):");
-        drawTextSmall(3.0f, 5.5f, "Invincible - Eat ghosts!");
-        drawTextSmall(3.0f, 4.8f, "Freeze - Stops ghosts");
-        drawTextSmall(3.0f, 4.1f, "Speed - Move faster");
-
-        drawText(6.5f, 2.0f, "Press M for Menu");
-    }
-    else if (gameState == HIGHSCORE) {
-        drawText(6.5f, 12.0f, "HIGH SCORE");
-        std::string hs = "Best Score: " + intToString(highScore);
-        drawText(6.0f, 10.0f, hs.c_str());
-        drawText(6.5f, 8.0f, "Press M for Menu");
-    }
-    else if (gameState == PLAYING || gameState == PAUSED) {
-        drawBoard();
-        drawPacman();
-        for (size_t i = 0; i < ghosts.size(); i++) {
-            drawGhost(ghosts[i]);
-        }
-
-        std::string scoreText = "Score: " + intToString(score);
-        std::string livesText = "Lives: " + intToString(lives);
-        std::string timeText = "Time: " + intToString(gameTime) + "s";
-        drawTextSmall(0.5f, 19.5f, scoreText.c_str());
-        drawTextSmall(7.0f, 19.5f, timeText.c_str());
-        drawTextSmall(14.0f, 19.5f, livesText.c_str());
-
-        if (activePowerUp >= 0) {
-            std::string powerText = "POWER: ";
-            if (activePowerUp == 0) powerText += "INVINCIBLE!";
-            else if (activePowerUp == 1) powerText += "FREEZE!";
-            else if (activePowerUp == 2) powerText += "SPEED!";
-            drawTextSmall(6.0f, 0.5f, powerText.c_str());
-        }
-
-        if (gameState == PAUSED) {
-            drawText(5.5f, 10.0f, "PAUSED - Press P to Resume");
-        }
-    }
-    else if (gameState == GAMEOVER) {
-        drawText(7.0f, 13.0f, "GAME OVER!");
-        std::string finalScore = "Final Score: " + intToString(score);
-        std::string finalTime = "Time: " + intToString(gameTime) + " seconds";
-        drawText(6.0f, 11.0f, finalScore.c_str());
-        drawText(6.0f, 10.0f, finalTime.c_str());
-        drawText(6.5f, 8.0f, "Press M for Menu");
-    }
-    else if (gameState == WIN) {
-        drawText(7.5f, 13.0f, "YOU WIN!");
-        std::string finalScore = "Final Score: " + intToString(score);
-        std::string finalTime = "Time: " + intToString(gameTime) + " seconds";
-        drawText(6.0f, 11.0f, finalScore.c_str());
-        drawText(6.0f, 10.0f, finalTime.c_str());
-        if (score > highScore) {
-            drawText(5.5f, 9.0f, "NEW HIGH SCORE!");
-        }
-        drawText(6.5f, 7.0f, "Press M for Menu");
-    }
-
-    glutSwapBuffers();
-}
-
-// ---------------------- Keyboard Input Handler ----------------------
-// Processes all keyboard inputs for game control
-// ESC: Exit game immediately
-// SPACE: Start new game from menu
-// R: Resume game if paused
-// H: Open help screen from menu
-// S: Open high score screen (also Down movement in-game)
-// M: Return to menu from any screen
-// P: Pause/unpause during gameplay
-// W/A/S/D: Movement controls (Up/Left/Down/Right)
-// Movement only active during PLAYING state
-
-void keyboard(unsigned char key, int x, int y) {
-    switch (key) {
-        case 27: exit(0); break; // ESC
-        case ' ': // SPACE
-            if (gameState == MENU) {
-                resetGame();
-                gameState = PLAYING;
-            }
-            break;
-        case 'r': case 'R':
-            if (gameState == MENU && previousState == PAUSED) {
-                gameState = PLAYING;
-            }
-            break;
-        case 'h': case 'H':
-            if (gameState == MENU) {
-                gameState = HELP;
-            }
-            break;
-        case 's': case 'S':
-            if (gameState == MENU) {
-                gameState = HIGHSCORE;
-            } else if (gameState == PLAYING) {
-                pacman.dirX = 0; pacman.dirY = -1;
-            }
-            break;
-        case 'm': case 'M':
-            if (gameState != PLAYING) {
-                gameState = MENU;
-            }
-            break;
-        case 'p': case 'P':
-            if (gameState == PLAYING) {
-                previousState = PAUSED;
-                gameState = PAUSED;
-            } else if (gameState == PAUSED) {
-                gameState = PLAYING;
-            }
-            break;
-        case 'w': case 'W':
-            if (gameState == PLAYING) {
-                pacman.dirX = 0; pacman.dirY = 1;
-            }
-            break;
-        case 'a': case 'A':
-            if (gameState == PLAYING) {
-                pacman.dirX = -1; pacman.dirY = 0;
-            }
-            break;
-        case 'd': case 'D':
-            if (gameState == PLAYING) {
-                pacman.dirX = 1; pacman.dirY = 0;
-            }
-            break;
-
-            }
-}
-
-// ---------------------- Timer Callback Function ----------------------
-// Called repeatedly at 60 FPS (every 16.67ms)
-// Updates game logic by calling updateGame()
-// Triggers screen redraw with glutPostRedisplay()
-// Reschedules itself to maintain constant frame rate
-// This creates the game loop for smooth animation
-
-void timer(int) {
-    updateGame();
-    glutPostRedisplay();
-    glutTimerFunc(1000/60, timer, 0);
-}
-
-// ---------------------- Main Entry Point ----------------------
-// Initializes random number generator for ghost AI
-// Sets up GLUT window and OpenGL context
-// Configures double buffering for smooth graphics
-// Creates 800x800 pixel window with title
-// Sets up 2D orthographic projection (0-20 range for game grid)
-// Loads high score from file
-// Resets game to initial state
-// Registers callback functions:
-//   - display() for rendering
-//   - keyboard() for input
-//   - timer() for game loop
-// Starts GLUT main loop (runs until exit)
-
-int main(int argc, char** argv) {
-    srand(time(0));
-
-    glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
-    glutInitWindowSize(windowWidth, windowHeight);
-    glutCreateWindow("Pacman Game - Complete Edition");
-
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluOrtho2D(0, COLS, 0, ROWS);
-
-    loadHighScore();
-    resetGame();
-
-    glutDisplayFunc(display);
-    glutKeyboardFunc(keyboard);
-    glutTimerFunc(0, timer, 0);
-
-    glutMainLoop();
-    return 0;
-}
+// ---------------------- Header Files & Constants ----------------------
+// Includes OpenGL/GLUT libraries for graphics rendering
+// Math library for trigonometric functions (sin, cos, circles)
+// Standard libraries for file I/O, vectors, time functions
+// Defines M_PI constant for mathematical calculations
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <direct.h>
+#include <io.h>
+#else
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+#include <GL/glut.h>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <sstream>
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Monotonic clock used for all frame, tick and input timing
+typedef std::chrono::steady_clock Clock;
+
+// ---------------------- Game State Management ----------------------
+// Enum defines all possible game screens/states
+// Current and previous state, score, lives and timers are per game
+// and live in the World struct (see Game World)
+// High score tracking; the leaderboard has its own section
+
+enum GameState { MENU, PLAYING, PAUSED, GAMEOVER, WIN, HELP, HIGHSCORE };
+int highScore = 0;
+
+// ---------------------- Runtime Settings ----------------------
+// Gameplay and engine tunables in one flat struct, read by the hot paths
+// Compiled-in defaults; pacman.cfg (or --config PATH) overrides them
+// Parsed once at startup: "key = value" per line, # starts a comment
+// Command-line flags such as --sim-hz win over the file
+// --print-config writes the current values in the same format
+// Ranges keep every move under one cell per tick (20 cells/s at 30 Hz
+// or more) and worker threads within the job system's thread slots
+
+const int MAX_GHOSTS = 4;
+const int MAX_JOB_THREADS = 64;
+const int SUBMITTING_THREADS = 2; // main and simulation, besides the workers
+
+struct Settings {
+    float pacmanSpeed;      // cells per second
+    float pacmanBoostSpeed; // with the speed power-up
+    float ghostSpeed[MAX_GHOSTS];
+    float ghostSpeedup;     // cells/s gained per second of each ramp
+    int speedupPeriod;      // seconds between ramps
+    float powerUpDuration;  // seconds
+    float collisionDistance;
+    int pelletScore;
+    int powerUpScore;
+    int ghostScore;
+    int startLives;
+    float pacmanSpawnX, pacmanSpawnY;
+    float ghostSpawnX[MAX_GHOSTS], ghostSpawnY[MAX_GHOSTS];
+    float ghostRespawnX, ghostRespawnY;
+    int simHz;              // every movement and timer scales by dt = 1/simHz
+    int renderHz;
+    int windowWidth, windowHeight;
+    int workerThreads;      // 0 picks one per spare core
+    int inputDelay;         // lockstep: ticks from a key press to the tick it applies on
+};
+
+const Settings DEFAULT_SETTINGS = {
+    6.0f, 9.0f,
+    { 2.4f, 2.1f, 2.28f, 1.8f },
+    3.6f, 30,
+    5.0f,
+    0.6f,
+    10, 50, 100,
+    3,
+    1, 1,
+    { 18, 1, 18, 10 }, { 18, 18, 1, 10 },
+    10, 10,
+    60, 60,
+    800, 800,
+    0,
+    3
+};
+
+Settings settings = DEFAULT_SETTINGS;
+
+struct SettingKey {
+    const char *name;
+    bool isFloat;
+    void *value;
+    double minValue, maxValue;
+};
+
+const SettingKey SETTING_KEYS[] = {
+    { "pacman.speed", true, &settings.pacmanSpeed, 0.1, 20 },
+    { "pacman.boost_speed", true, &settings.pacmanBoostSpeed, 0.1, 20 },
+    { "pacman.spawn_x", true, &settings.pacmanSpawnX, 1, 18 },
+    { "pacman.spawn_y", true, &settings.pacmanSpawnY, 1, 18 },
+    { "ghost.blinky.speed", true, &settings.ghostSpeed[0], 0, 20 },
+    { "ghost.pinky.speed", true, &settings.ghostSpeed[1], 0, 20 },
+    { "ghost.inky.speed", true, &settings.ghostSpeed[2], 0, 20 },
+    { "ghost.clyde.speed", true, &settings.ghostSpeed[3], 0, 20 },
+    { "ghost.blinky.spawn_x", true, &settings.ghostSpawnX[0], 1, 18 },
+    { "ghost.blinky.spawn_y", true, &settings.ghostSpawnY[0], 1, 18 },
+    { "ghost.pinky.spawn_x", true, &settings.ghostSpawnX[1], 1, 18 },
+    { "ghost.pinky.spawn_y", true, &settings.ghostSpawnY[1], 1, 18 },
+    { "ghost.inky.spawn_x", true, &settings.ghostSpawnX[2], 1, 18 },
+    { "ghost.inky.spawn_y", true, &settings.ghostSpawnY[2], 1, 18 },
+    { "ghost.clyde.spawn_x", true, &settings.ghostSpawnX[3], 1, 18 },
+    { "ghost.clyde.spawn_y", true, &settings.ghostSpawnY[3], 1, 18 },
+    { "ghost.respawn_x", true, &settings.ghostRespawnX, 1, 18 },
+    { "ghost.respawn_y", true, &settings.ghostRespawnY, 1, 18 },
+    { "ghost.speedup", true, &settings.ghostSpeedup, 0, 60 },
+    { "ghost.speedup_period", false, &settings.speedupPeriod, 1, 3600 },
+    { "powerup.duration", true, &settings.powerUpDuration, 0, 600 },
+    { "collision.distance", true, &settings.collisionDistance, 0, 2 },
+    { "score.pellet", false, &settings.pelletScore, 0, 1000000 },
+    { "score.power_up", false, &settings.powerUpScore, 0, 1000000 },
+    { "score.ghost", false, &settings.ghostScore, 0, 1000000 },
+    { "lives", false, &settings.startLives, 1, 99 },
+    { "engine.sim_hz", false, &settings.simHz, 30, 10000 },
+    { "engine.render_hz", false, &settings.renderHz, 1, 1000 },
+    { "engine.worker_threads", false, &settings.workerThreads, 0, MAX_JOB_THREADS - SUBMITTING_THREADS },
+    { "window.width", false, &settings.windowWidth, 100, 8192 },
+    { "window.height", false, &settings.windowHeight, 100, 8192 },
+    { "net.input_delay", false, &settings.inputDelay, 1, 30 },
+};
+const int SETTING_KEY_COUNT = sizeof(SETTING_KEYS) / sizeof(SETTING_KEYS[0]);
+
+static std::string trimSpace(const std::string &s) {
+    size_t begin = s.find_first_not_of(" \t\r");
+    if (begin == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r");
+    return s.substr(begin, end - begin + 1);
+}
+
+// Applies one "key = value" setting; complains and keeps the old value on bad input
+bool applySetting(const std::string &key, const std::string &text, const char *where) {
+    for (int k = 0; k < SETTING_KEY_COUNT; k++) {
+        const SettingKey &sk = SETTING_KEYS[k];
+        if (key != sk.name) continue;
+
+        char *end = 0;
+        double v = strtod(text.c_str(), &end);
+        if (text.empty() || *end != '\0' || !(v >= sk.minValue && v <= sk.maxValue)) {
+            fprintf(stderr, "%s: %s must be a number in [%g, %g], got '%s'\n",
+                    where, sk.name, sk.minValue, sk.maxValue, text.c_str());
+            return false;
+        }
+        if (sk.isFloat) *(float*)sk.value = (float)v;
+        else if (v != (int)v) {
+            fprintf(stderr, "%s: %s must be a whole number, got '%s'\n", where, sk.name, text.c_str());
+            return false;
+        } else *(int*)sk.value = (int)v;
+        return true;
+    }
+    fprintf(stderr, "%s: unknown setting '%s'\n", where, key.c_str());
+    return false;
+}
+
+// Reads a settings file; a missing file is only an error when asked for by name
+bool loadSettings(const std::string &path, bool required) {
+    std::ifstream in(path.c_str());
+    if (!in) {
+        if (required) fprintf(stderr, "Cannot open config %s\n", path.c_str());
+        return !required;
+    }
+
+    std::string line;
+    int lineNo = 0;
+    bool ok = true;
+    while (std::getline(in, line)) {
+        lineNo++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        line = trimSpace(line);
+        if (line.empty()) continue;
+
+        std::string where = path + ":" + std::to_string(lineNo);
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            fprintf(stderr, "%s: expected key = value\n", where.c_str());
+            ok = false;
+            continue;
+        }
+        if (!applySetting(trimSpace(line.substr(0, eq)), trimSpace(line.substr(eq + 1)), where.c_str()))
+            ok = false;
+    }
+    return ok;
+}
+
+void printSettings(FILE *out) {
+    fprintf(out, "# Pacman settings; remove a line to fall back to its default\n");
+    for (int k = 0; k < SETTING_KEY_COUNT; k++) {
+        const SettingKey &sk = SETTING_KEYS[k];
+        if (sk.isFloat) fprintf(out, "%s = %g\n", sk.name, *(const float*)sk.value);
+        else fprintf(out, "%s = %d\n", sk.name, *(const int*)sk.value);
+    }
+}
+
+// One simulation tick at the configured rate, as the sim loop steps it
+Clock::duration tickDuration() {
+    return std::chrono::nanoseconds(1000000000LL / settings.simHz);
+}
+
+// ---------------------- Fixed Point ----------------------
+// Positions, speeds and timers in the simulation are 16.16 fixed-point
+// integers, so a game is bit-exact on every compiler, optimization level
+// and machine: no float rounding left to differ between builds
+// Settings stay floats for editing and are converted where the
+// simulation reads them; snapshots, spectators and the network convert
+// back to floats at the edge
+
+typedef int32_t Fixed;
+
+const int FIXED_SHIFT = 16;
+const Fixed FIXED_ONE = 1 << FIXED_SHIFT;
+
+inline Fixed toFixed(float v) {
+    double scaled = (double)v * FIXED_ONE; // exact: a power of two
+    return (Fixed)(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+}
+
+inline Fixed intToFixed(int v) {
+    return (Fixed)(v * FIXED_ONE);
+}
+
+inline float fixedToFloat(Fixed v) {
+    return (float)v / FIXED_ONE;
+}
+
+inline Fixed fixedMul(Fixed a, Fixed b) {
+    return (Fixed)(((int64_t)a * b) >> FIXED_SHIFT);
+}
+
+// Cell of a position inside the maze, the whole part; a negative position
+// floors to a negative cell, so board reads go through boardIndex(),
+// which rejects anything off the board
+inline int fixedCell(Fixed v) {
+    return v >> FIXED_SHIFT;
+}
+
+// Longest move in one tick: under a cell, so no move jumps a wall
+const Fixed MAX_STEP = FIXED_ONE * 15 / 16;
+
+// floor(sqrt(v)) for v below 2^62: the hardware square root gives an
+// estimate and integer compares correct it, so the result is exact
+// whatever the FPU rounds to
+inline uint64_t isqrt64(uint64_t v) {
+    uint64_t root = (uint64_t)std::sqrt((double)v);
+    while (root * root > v) root--;
+    while ((root + 1) * (root + 1) <= v) root++;
+    return root;
+}
+
+// One simulation tick in 16.16 seconds, dt for updateGame(); rounded, so
+// the world carries the error from tick to tick (see carryTickError())
+Fixed tickFixed() {
+    return (Fixed)((FIXED_ONE + settings.simHz / 2) / settings.simHz);
+}
+
+// ---------------------- Entity Storage ----------------------
+// Pacmen, ghosts and power-ups are entity kinds, each stored as an
+// archetype table: one dense column per component, indexed by row, so a
+// row is an entity and its components sit at the same index in every column
+// Systems name the components they use and run over those columns alone
+// (each()); a system over Position works for any kind that has one
+// spawn() appends a row and resize() adds or drops rows at the end; both
+// reuse capacity, so a world that keeps its counts never allocates
+// A new kind is one more Archetype in World, listing its components
+
+template <typename... Components>
+class Archetype {
+public:
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    template <typename C> C *column() { return std::get<std::vector<C> >(columns).data(); }
+    template <typename C> const C *column() const { return std::get<std::vector<C> >(columns).data(); }
+    template <typename C> C &get(size_t row) { return column<C>()[row]; }
+    template <typename C> const C &get(size_t row) const { return column<C>()[row]; }
+
+    size_t spawn(const Components &... values) {
+        int expand[] = { 0, (std::get<std::vector<Components> >(columns).push_back(values), 0)... };
+        (void)expand;
+        return count++;
+    }
+    void resize(size_t rows) {
+        int expand[] = { 0, (std::get<std::vector<Components> >(columns).resize(rows), 0)... };
+        (void)expand;
+        count = rows;
+    }
+    void clear() {
+        resize(0);
+    }
+
+private:
+    std::tuple<std::vector<Components>...> columns;
+    size_t count = 0;
+};
+
+// Runs fn(row, components...) for rows [begin, end) of a table, passing
+// the components listed in Cs; whole-table form below
+template <typename... Cs, typename Table, typename Fn>
+void each(Table &table, size_t begin, size_t end, Fn fn) {
+    for (size_t row = begin; row < end; row++) fn(row, table.template get<Cs>(row)...);
+}
+
+template <typename... Cs, typename Table, typename Fn>
+void each(Table &table, Fn fn) {
+    each<Cs...>(table, 0, table.size(), fn);
+}
+
+// Where an entity is, 16.16 cells; Pacmen and ghosts both have one
+struct Position {
+    Fixed x, y;
+};
+
+// ---------------------- Pacman Components ----------------------
+// A Pacman is Position, Motion, Steering and PlayerStats
+// Motion: direction vectors (dirX, dirY) and speed in cells per second
+// Steering: queued turn, held until the maze lets Pacman take it; key
+// press time rides along with the turn for latency measurement
+// Up to MAX_PLAYERS Pacmen share the maze in multiplayer games, each
+// with its own score and lives; player 0 is the single-player Pacman
+// A Pacman out of lives is out of play until the next game
+
+struct Motion {
+    int dirX, dirY;
+    Fixed speed;
+};
+
+struct Steering {
+    int queuedDirX, queuedDirY;
+    bool hasQueuedTurn;
+    bool turnIsFresh; // queued during this tick's input drain
+    Clock::time_point queuedStamp;
+};
+
+struct PlayerStats {
+    int score;
+    int lives;
+};
+
+const int MAX_PLAYERS = 4;
+
+// ---------------------- Ghost Components & AI ----------------------
+// A ghost is Position and GhostMind: speed (cells per second),
+// 16.16 fixed point
+// Behavior type determines AI pattern (chase, ambush, patrol, random)
+// Special timer for behavior timing
+// isActive flag to enable/disable ghost
+// Own random stream so ghosts can update on any thread
+// Name and RGB color never change, so they live in GHOST_ROSTER and a
+// ghost keeps only its roster id: 16 plain bytes, copied with memcpy
+
+struct GhostProfile {
+    const char *name;
+    float r, g, b;
+};
+
+const GhostProfile GHOST_ROSTER[] = {
+    { "Blinky", 1.0f, 0.0f, 0.0f }, // red
+    { "Pinky",  1.0f, 0.4f, 0.7f }, // pink
+    { "Inky",   0.0f, 1.0f, 1.0f }, // cyan
+    { "Clyde",  1.0f, 0.6f, 0.0f }, // orange
+};
+static_assert(sizeof(GHOST_ROSTER) / sizeof(GHOST_ROSTER[0]) == MAX_GHOSTS, "one roster entry per ghost");
+
+struct GhostMind {
+    Fixed speed;
+    Fixed specialTimer;
+    unsigned int rng;
+    uint8_t id;       // GHOST_ROSTER entry
+    uint8_t behavior; // 0=chase, 1=ambush, 2=patrol, 3=random
+    bool isActive;
+};
+
+static_assert(std::is_trivially_copyable<GhostMind>::value && sizeof(GhostMind) <= 16, "ghost state is a small plain record");
+
+// xorshift32: small, fast and safe to run per ghost in parallel
+unsigned int nextRandom(unsigned int &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// ---------------------- Power-up System ----------------------
+// A power-up is Cell and Pickup, at a specific cell with its type
+// Type 0: Invincibility (eat ghosts)
+// Type 1: Freeze (stop ghosts)
+// Type 2: Speed boost
+// Active flag and duration timer for each power-up
+
+struct Cell {
+    int x, y;
+};
+
+struct Pickup {
+    int type; // 0=invincible, 1=freeze, 2=speed
+    bool active;
+    Fixed duration;
+};
+
+// ---------------------- Game Board/Grid ----------------------
+// 20x20 grid system for the maze
+// Cell values: 0=empty, 1=pellet, 2=wall, 3=power-up
+// Total pellets counter to check win condition, kept live as pellets are eaten
+
+const int ROWS = 20;
+const int COLS = 20;
+
+// ---------------------- Input Queue ----------------------
+// keyboard() runs on the GLUT thread and only records key presses
+// Each press is stamped with the monotonic clock when it arrived
+// Single-producer/single-consumer ring: GLUT thread pushes, sim thread pops
+// Drained at the start of every tick so each input belongs to one tick
+// A full queue drops the newest press rather than blocking the callback
+
+struct InputEvent {
+    unsigned char key;
+    Clock::time_point stamp;
+};
+
+template <typename T, unsigned N>
+class SpscQueue {
+public:
+    bool push(const T &item) {
+        unsigned t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N) return false;
+        items[t % N] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    bool pop(T &item) {
+        unsigned h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        item = items[h % N];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T items[N];
+    std::atomic<unsigned> head{0}; // advanced by the consumer
+    std::atomic<unsigned> tail{0}; // advanced by the producer
+};
+
+SpscQueue<InputEvent, 64> inputQueue;
+unsigned int inputsHandled = 0; // sim thread count, published with snapshots
+
+// ---------------------- Metrics Registry ----------------------
+// Process-wide counters, gauges and histograms with fixed ids
+// Each thread writes only its own shard, so updates are plain relaxed
+// stores with no contention; readers add the shards together
+// Threads past MAX_METRIC_SHARDS share one overflow shard, updated with
+// atomic adds, which readers add in as well
+// Gauges hold a last value and live in one shared slot
+// Histogram buckets are upper bounds in seconds, Prometheus style
+
+enum CounterId {
+    M_TICKS, M_FRAMES, M_DROPPED_FRAMES, M_GHOST_UPDATES, M_COLLISIONS,
+    M_PELLETS_EATEN, M_POWER_UPS, M_GHOSTS_EATEN, M_LIVES_LOST, M_ARENA_OVERFLOWS, COUNTER_COUNT
+};
+
+enum GaugeId {
+    G_SCORE, G_LIVES, G_PELLETS_LEFT, G_GAME_STATE, G_TICK_ARENA_BYTES, G_FRAME_ARENA_BYTES, GAUGE_COUNT
+};
+
+enum HistogramId { H_TICK_SECONDS, H_FRAME_SECONDS, HISTOGRAM_COUNT };
+
+const int HISTOGRAM_BUCKETS = 10;
+
+struct MetricInfo {
+    const char *name;
+    const char *help;
+};
+
+const MetricInfo counterInfo[COUNTER_COUNT] = {
+    { "pacman_ticks_total", "Simulation ticks run" },
+    { "pacman_frames_total", "Frames rendered" },
+    { "pacman_dropped_frames_total", "Display deadlines skipped" },
+    { "pacman_ghost_updates_total", "Ghost AI updates" },
+    { "pacman_collisions_total", "Pacman-ghost collisions" },
+    { "pacman_pellets_eaten_total", "Pellets eaten" },
+    { "pacman_power_ups_total", "Power-ups activated" },
+    { "pacman_ghosts_eaten_total", "Ghosts eaten while invincible" },
+    { "pacman_lives_lost_total", "Lives lost" },
+    { "pacman_arena_overflows_total", "Frame arena requests that went to the heap" },
+};
+
+const MetricInfo gaugeInfo[GAUGE_COUNT] = {
+    { "pacman_score", "Current score" },
+    { "pacman_lives", "Lives left" },
+    { "pacman_pellets_left", "Pellets left on the board" },
+    { "pacman_game_state", "GameState enum value" },
+    { "pacman_tick_arena_bytes", "Most frame arena memory in use during the last tick" },
+    { "pacman_frame_arena_bytes", "Most frame arena memory in use during the last frame" },
+};
+
+const MetricInfo histogramInfo[HISTOGRAM_COUNT] = {
+    { "pacman_tick_seconds", "Time spent in one simulation tick" },
+    { "pacman_frame_seconds", "Time spent drawing one frame, swap excluded" },
+};
+
+const double histogramBounds[HISTOGRAM_COUNT][HISTOGRAM_BUCKETS] = {
+    { 1e-7, 2.5e-7, 5e-7, 1e-6, 2.5e-6, 5e-6, 1e-5, 1e-4, 1e-3, 1e-2 },
+    { 2.5e-4, 5e-4, 1e-3, 2e-3, 4e-3, 8e-3, 1.6e-2, 3.3e-2, 6.6e-2, 0.1 },
+};
+
+struct MetricShard {
+    std::atomic<uint64_t> counters[COUNTER_COUNT];
+    std::atomic<uint64_t> buckets[HISTOGRAM_COUNT][HISTOGRAM_BUCKETS + 1]; // last is +Inf
+    std::atomic<uint64_t> sumNanos[HISTOGRAM_COUNT];
+};
+
+const int MAX_METRIC_SHARDS = 128;
+
+struct MetricRegistry {
+    MetricShard *shards[MAX_METRIC_SHARDS];
+    std::atomic<int> shardCount{0};
+    MetricShard overflow; // shared by every thread without a shard
+    std::atomic<double> gauges[GAUGE_COUNT];
+} metrics;
+
+thread_local MetricShard *metricShard = 0;
+std::mutex metricShardLock;
+
+MetricShard &currentMetricShard() {
+    if (!metricShard) {
+        std::lock_guard<std::mutex> lock(metricShardLock);
+        int index = metrics.shardCount.load();
+        if (index >= MAX_METRIC_SHARDS) {
+            metricShard = &metrics.overflow;
+        } else {
+            metricShard = new MetricShard();
+            metrics.shards[index] = metricShard;
+            metrics.shardCount.store(index + 1);
+        }
+    }
+    return *metricShard;
+}
+
+// Owned shards have one writer; the overflow shard has many
+inline void bumpShard(const MetricShard &shard, std::atomic<uint64_t> &value, uint64_t n) {
+    if (&shard == &metrics.overflow) {
+        value.fetch_add(n, std::memory_order_relaxed);
+    } else {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+}
+
+inline void countMetric(CounterId id, uint64_t n = 1) {
+    MetricShard &shard = currentMetricShard();
+    bumpShard(shard, shard.counters[id], n);
+}
+
+inline void setGauge(GaugeId id, double value) {
+    metrics.gauges[id].store(value, std::memory_order_relaxed);
+}
+
+inline void observeMetric(HistogramId id, double seconds) {
+    MetricShard &shard = currentMetricShard();
+    int bucket = 0;
+    while (bucket < HISTOGRAM_BUCKETS && seconds > histogramBounds[id][bucket]) bucket++;
+    bumpShard(shard, shard.buckets[id][bucket], 1);
+    bumpShard(shard, shard.sumNanos[id], (uint64_t)(seconds * 1e9));
+}
+
+uint64_t readCounter(CounterId id) {
+    uint64_t total = metrics.overflow.counters[id].load(std::memory_order_relaxed);
+    int count = std::min(metrics.shardCount.load(), MAX_METRIC_SHARDS);
+    for (int i = 0; i < count; i++) {
+        total += metrics.shards[i]->counters[id].load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+// ---------------------- Frame Phase Tracer ----------------------
+// --trace PATH records begin/end events and writes Chrome trace-event
+// JSON at exit (load it in chrome://tracing or Perfetto)
+// TRACE_SCOPE marks a block; when tracing is off the only cost is one
+// branch on a flag that never changes after startup
+// Each thread appends to its own fixed buffer, no locks while recording
+// A full buffer drops further events and says so in the output
+
+const int TRACE_EVENTS_PER_THREAD = 1 << 18;
+const int MAX_TRACE_THREADS = 64;
+
+bool tracingEnabled = false;
+std::string tracePath;
+Clock::time_point traceStart;
+
+struct TraceEvent {
+    const char *name;
+    int arg;       // -1 for none
+    char phase;    // 'B' or 'E'
+    Clock::time_point time;
+};
+
+struct TraceBuffer {
+    const char *threadName;
+    TraceEvent *events;
+    int count;
+    unsigned long dropped;
+};
+
+TraceBuffer *traceBuffers[MAX_TRACE_THREADS];
+std::atomic<int> traceBufferCount{0};
+std::mutex traceRegisterLock;
+thread_local TraceBuffer *traceBuffer = 0;
+thread_local const char *traceThreadName = "thread";
+
+TraceBuffer *currentTraceBuffer() {
+    if (!traceBuffer) {
+        std::lock_guard<std::mutex> lock(traceRegisterLock);
+        int index = traceBufferCount.load();
+        if (index >= MAX_TRACE_THREADS) return 0;
+        traceBuffer = new TraceBuffer();
+        traceBuffer->threadName = traceThreadName;
+        traceBuffer->events = new TraceEvent[TRACE_EVENTS_PER_THREAD];
+        traceBuffers[index] = traceBuffer;
+        traceBufferCount.store(index + 1);
+    }
+    return traceBuffer;
+}
+
+void recordTraceEvent(const char *name, int arg, char phase) {
+    TraceBuffer *buffer = currentTraceBuffer();
+    if (!buffer) return;
+    if (buffer->count == TRACE_EVENTS_PER_THREAD) {
+        buffer->dropped++;
+        return;
+    }
+    TraceEvent &event = buffer->events[buffer->count];
+    event.name = name;
+    event.arg = arg;
+    event.phase = phase;
+    event.time = Clock::now();
+    buffer->count++;
+}
+
+struct TraceScope {
+    const char *name;
+    int arg;
+
+    TraceScope(const char *name, int arg = -1) : name(name), arg(arg) {
+        if (tracingEnabled) recordTraceEvent(name, arg, 'B');
+    }
+    ~TraceScope() {
+        if (tracingEnabled) recordTraceEvent(name, arg, 'E');
+    }
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(traceScope, __LINE__)(__VA_ARGS__)
+
+void nameTraceThread(const char *name) {
+    traceThreadName = name;
+}
+
+// Called at exit after the other threads have been stopped
+void writeTrace() {
+    if (!tracingEnabled) return;
+    std::ofstream file(tracePath.c_str());
+    if (!file.is_open()) {
+        std::cerr << "Cannot write trace " << tracePath << std::endl;
+        return;
+    }
+
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    int count = traceBufferCount.load();
+    for (int t = 0; t < count; t++) {
+        const TraceBuffer &buffer = *traceBuffers[t];
+        file << (first ? "" : ",\n")
+             << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t
+             << ",\"args\":{\"name\":\"" << buffer.threadName << "\"}}";
+        first = false;
+        for (int i = 0; i < buffer.count; i++) {
+            const TraceEvent &event = buffer.events[i];
+            double us = std::chrono::duration<double, std::micro>(event.time - traceStart).count();
+            file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"" << event.phase
+                 << "\",\"pid\":1,\"tid\":" << t << ",\"ts\":" << std::fixed << us;
+            if (event.arg >= 0) {
+                file << ",\"args\":{\"index\":" << event.arg << "}";
+            }
+            file << "}";
+        }
+        if (buffer.dropped) {
+            std::cerr << "Trace buffer for " << buffer.threadName << " dropped "
+                      << buffer.dropped << " events" << std::endl;
+        }
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+// ---------------------- Heap Allocation Counter ----------------------
+// Debug builds (no NDEBUG) and builds with -DPACMAN_COUNT_ALLOCATIONS
+// replace the global operator new with one that counts per thread
+// Once a state has run for a tick, the simulation tick and the frame
+// must not allocate: both check and abort naming the path, and
+// --bench-sim fails on any allocation in a tick spent playing
+// The first tick or frame of each state may set things up (a thread's
+// trace buffer and metric shard, a new game's replay buffer)
+// Release builds have no counter and no checks
+
+#if !defined(NDEBUG) || defined(PACMAN_COUNT_ALLOCATIONS)
+#define COUNT_ALLOCATIONS 1
+#endif
+
+thread_local uint64_t threadAllocations = 0;
+
+#ifdef COUNT_ALLOCATIONS
+void *countedAlloc(size_t size, size_t align) {
+    threadAllocations++;
+    if (size == 0) size = 1;
+    void *p = 0;
+    if (align <= alignof(std::max_align_t)) {
+        p = std::malloc(size);
+    } else {
+#ifdef _WIN32
+        p = _aligned_malloc(size, align);
+#else
+        if (posix_memalign(&p, align, size) != 0) p = 0;
+#endif
+    }
+    return p;
+}
+
+// Kept out of line so GCC does not pair the inlined free() with new
+#ifdef __GNUC__
+__attribute__((noinline))
+#endif
+void countedFree(void *p, size_t align) {
+#ifdef _WIN32
+    if (align > alignof(std::max_align_t)) {
+        _aligned_free(p);
+        return;
+    }
+#else
+    (void)align;
+#endif
+    std::free(p);
+}
+
+void *operator new(size_t size) {
+    if (void *p = countedAlloc(size, 0)) return p;
+    throw std::bad_alloc();
+}
+void *operator new[](size_t size) {
+    if (void *p = countedAlloc(size, 0)) return p;
+    throw std::bad_alloc();
+}
+void *operator new(size_t size, std::align_val_t align) {
+    if (void *p = countedAlloc(size, (size_t)align)) return p;
+    throw std::bad_alloc();
+}
+void *operator new[](size_t size, std::align_val_t align) {
+    if (void *p = countedAlloc(size, (size_t)align)) return p;
+    throw std::bad_alloc();
+}
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return countedAlloc(size, 0); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return countedAlloc(size, 0); }
+void operator delete(void *p) noexcept { countedFree(p, 0); }
+void operator delete[](void *p) noexcept { countedFree(p, 0); }
+void operator delete(void *p, size_t) noexcept { countedFree(p, 0); }
+void operator delete[](void *p, size_t) noexcept { countedFree(p, 0); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { countedFree(p, 0); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { countedFree(p, 0); }
+void operator delete(void *p, std::align_val_t align) noexcept { countedFree(p, (size_t)align); }
+void operator delete[](void *p, std::align_val_t align) noexcept { countedFree(p, (size_t)align); }
+void operator delete(void *p, size_t, std::align_val_t align) noexcept { countedFree(p, (size_t)align); }
+void operator delete[](void *p, size_t, std::align_val_t align) noexcept { countedFree(p, (size_t)align); }
+#endif
+
+// Allocations this thread has made so far
+inline uint64_t allocationMark() {
+    return threadAllocations;
+}
+
+// Aborts if the thread allocated since mark, when steady says it must not
+void expectNoAllocations(const char *path, uint64_t mark, bool steady) {
+#ifdef COUNT_ALLOCATIONS
+    if (!steady || threadAllocations == mark) return;
+    std::fprintf(stderr, "[alloc] %s made %llu heap allocations in a steady-state run\n", path,
+                 (unsigned long long)(threadAllocations - mark));
+    std::abort();
+#endif
+}
+
+// ---------------------- Frame Arena ----------------------
+// Scratch memory for data that lives no longer than one tick or frame:
+// the board's render lists, search queues, the tick's event batch
+// One bump-pointer arena per thread, allocated on first use and freed
+// when the thread exits; freeing is a no-op except for the newest block,
+// so a vector can grow in place
+// beginFrameArena() at the start of each tick and frame releases it all
+// and keeps how much was in use at most (the high-water mark);
+// FrameArenaScope releases what a call made on return, so updateGame()
+// tidies up after itself on threads that never begin a frame
+// FrameAllocator<T> lets STL containers live there (FrameVector<T>);
+// such containers belong to the thread that made them and to the frame
+// A request that does not fit goes to the heap, with its alignment kept,
+// and is counted
+
+const size_t FRAME_ARENA_BYTES = 256 * 1024;
+
+struct FrameArena {
+    unsigned char *memory;
+    size_t used;
+    size_t highWater;     // most in use at once in this frame
+    size_t lastHighWater; // the same for the frame before
+    size_t peakHighWater; // any frame's
+    uint64_t overflows;
+    ~FrameArena() { delete[] memory; }
+};
+
+thread_local std::unique_ptr<FrameArena> frameArena;
+
+FrameArena &currentFrameArena() {
+    if (!frameArena) {
+        frameArena.reset(new FrameArena());
+        frameArena->memory = new unsigned char[FRAME_ARENA_BYTES];
+    }
+    return *frameArena;
+}
+
+inline bool overAligned(size_t align) {
+    return align > __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+}
+
+FrameArena &beginFrameArena() {
+    FrameArena &arena = currentFrameArena();
+    arena.lastHighWater = arena.highWater;
+    arena.peakHighWater = std::max(arena.peakHighWater, arena.highWater);
+    arena.used = 0;
+    arena.highWater = 0;
+    return arena;
+}
+
+void *frameAllocate(size_t size, size_t align) {
+    FrameArena &arena = currentFrameArena();
+    size_t start = (arena.used + align - 1) & ~(align - 1);
+    if (size > FRAME_ARENA_BYTES - start || start > FRAME_ARENA_BYTES) {
+        arena.overflows++;
+        countMetric(M_ARENA_OVERFLOWS);
+        return overAligned(align) ? ::operator new(size, std::align_val_t(align)) : ::operator new(size);
+    }
+    arena.used = start + size;
+    arena.highWater = std::max(arena.highWater, arena.used);
+    return arena.memory + start;
+}
+
+void frameFree(void *p, size_t size, size_t align) {
+    FrameArena &arena = currentFrameArena();
+    unsigned char *block = (unsigned char *)p;
+    if (block < arena.memory || block >= arena.memory + FRAME_ARENA_BYTES) { // an overflow
+        if (overAligned(align)) ::operator delete(p, std::align_val_t(align));
+        else ::operator delete(p);
+    } else if (block + size == arena.memory + arena.used) {
+        arena.used = block - arena.memory;
+    }
+}
+
+template <class T>
+T *frameArray(size_t count) {
+    return (T *)frameAllocate(count * sizeof(T), alignof(T));
+}
+
+struct FrameArenaScope {
+    size_t mark;
+    FrameArenaScope() : mark(currentFrameArena().used) {}
+    ~FrameArenaScope() { frameArena->used = std::min(frameArena->used, mark); }
+};
+
+template <class T>
+struct FrameAllocator {
+    typedef T value_type;
+    FrameAllocator() {}
+    template <class U> FrameAllocator(const FrameAllocator<U> &) {}
+    T *allocate(size_t count) { return frameArray<T>(count); }
+    void deallocate(T *p, size_t count) { frameFree(p, count * sizeof(T), alignof(T)); }
+};
+
+template <class T, class U>
+bool operator==(const FrameAllocator<T> &, const FrameAllocator<U> &) { return true; }
+template <class T, class U>
+bool operator!=(const FrameAllocator<T> &, const FrameAllocator<U> &) { return false; }
+
+template <class T>
+using FrameVector = std::vector<T, FrameAllocator<T> >;
+
+// ---------------------- Job System ----------------------
+// Shared work-stealing scheduler instead of one thread per feature
+// Every thread that submits work gets its own deque and job pool
+// Pool slots are recycled ring-style, skipping jobs still in flight
+// Owners push and pop at the bottom, idle threads steal from the top
+// A job counts itself plus its children; it finishes when all are done
+// waitForJob() runs other jobs while waiting instead of blocking
+// parallelFor() splits a range in halves down to a grain size
+// Ranges no larger than the grain run inline with no scheduling at all
+// Idle workers sleep on a condition variable so they cost no CPU
+// Stopping frees the pools and hands every thread index back; threads
+// that submit again after a restart register anew (generation changed)
+// A new thread sets its deque up under the deque's lock and only then
+// counts itself in threadCount, so stealers never see a half-made deque
+
+const int JOB_POOL_SIZE = 4096;  // per thread, power of two
+const int JOB_DEQUE_SIZE = 1024;
+
+struct Job {
+    void (*function)(Job *job);
+    void *context;
+    int begin, end;
+    Job *parent;
+    std::atomic<int> unfinished;
+};
+
+struct JobDeque {
+    std::mutex lock;
+    Job *jobs[JOB_DEQUE_SIZE];
+    int top, bottom; // steal from top, owner works at bottom
+    Job *pool;
+    unsigned poolNext;
+};
+
+struct JobSystem {
+    JobDeque deques[MAX_JOB_THREADS];
+    std::atomic<int> threadCount{0};
+    std::mutex registerLock; // one thread joins at a time
+    std::atomic<unsigned> generation{0};
+    std::atomic<int> queuedJobs{0};
+    std::atomic<int> sleepingWorkers{0};
+    std::atomic<bool> running{false};
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    std::vector<std::thread> workers;
+} jobs;
+
+thread_local int jobThreadIndex = -1;
+thread_local unsigned jobThreadGeneration = 0;
+
+int currentJobThread() {
+    unsigned generation = jobs.generation.load(std::memory_order_acquire);
+    if (jobThreadIndex < 0 || jobThreadGeneration != generation) {
+        std::lock_guard<std::mutex> join(jobs.registerLock);
+        jobThreadGeneration = generation;
+        jobThreadIndex = jobs.threadCount.load();
+        if (jobThreadIndex >= MAX_JOB_THREADS) {
+            std::cerr << "Too many job threads" << std::endl;
+            std::abort();
+        }
+        JobDeque &deque = jobs.deques[jobThreadIndex];
+        {
+            std::lock_guard<std::mutex> lock(deque.lock);
+            deque.top = deque.bottom = 0;
+            deque.pool = new Job[JOB_POOL_SIZE]();
+            deque.poolNext = 0;
+        }
+        jobs.threadCount.store(jobThreadIndex + 1);
+    }
+    return jobThreadIndex;
+}
+
+Job *createJob(void (*function)(Job *), void *context, Job *parent = 0) {
+    JobDeque &deque = jobs.deques[currentJobThread()];
+    Job *job = 0;
+    for (int tries = 0; tries < JOB_POOL_SIZE; tries++) {
+        Job *slot = &deque.pool[deque.poolNext++ & (JOB_POOL_SIZE - 1)];
+        if (slot->unfinished.load(std::memory_order_acquire) == 0) {
+            job = slot;
+            break;
+        }
+    }
+    if (!job) {
+        std::cerr << "Job pool exhausted" << std::endl;
+        std::abort();
+    }
+    job->function = function;
+    job->context = context;
+    job->begin = job->end = 0;
+    job->parent = parent;
+    job->unfinished.store(1, std::memory_order_relaxed);
+    if (parent) {
+        parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+void finishJob(Job *job) {
+    Job *parent = job->parent; // the slot may be reused once it reaches zero
+    if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1 && parent) {
+        finishJob(parent);
+    }
+}
+
+void executeJob(Job *job) {
+    job->function(job);
+    finishJob(job);
+}
+
+void runJob(Job *job) {
+    JobDeque &deque = jobs.deques[currentJobThread()];
+    {
+        std::lock_guard<std::mutex> lock(deque.lock);
+        if (deque.bottom - deque.top < JOB_DEQUE_SIZE) {
+            deque.jobs[deque.bottom % JOB_DEQUE_SIZE] = job;
+            deque.bottom++;
+            job = 0;
+        }
+    }
+    if (job) { // deque full, do it now
+        executeJob(job);
+        return;
+    }
+    jobs.queuedJobs.fetch_add(1);
+    if (jobs.sleepingWorkers.load() > 0) {
+        std::lock_guard<std::mutex> lock(jobs.sleepLock);
+        jobs.wake.notify_one();
+    }
+}
+
+Job *takeJob() {
+    int self = currentJobThread();
+    {
+        JobDeque &own = jobs.deques[self];
+        std::lock_guard<std::mutex> lock(own.lock);
+        if (own.bottom > own.top) {
+            own.bottom--;
+            jobs.queuedJobs.fetch_sub(1);
+            return own.jobs[own.bottom % JOB_DEQUE_SIZE];
+        }
+    }
+    int count = jobs.threadCount.load();
+    for (int n = 1; n < count; n++) {
+        JobDeque &victim = jobs.deques[(self + n) % count];
+        std::lock_guard<std::mutex> lock(victim.lock);
+        if (victim.bottom > victim.top) {
+            Job *job = victim.jobs[victim.top % JOB_DEQUE_SIZE];
+            victim.top++;
+            jobs.queuedJobs.fetch_sub(1);
+            return job;
+        }
+    }
+    return 0;
+}
+
+void waitForJob(Job *job) {
+    while (job->unfinished.load(std::memory_order_acquire) > 0) {
+        Job *next = takeJob();
+        if (next) {
+            executeJob(next);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void jobWorkerLoop() {
+    nameTraceThread("worker");
+    currentJobThread();
+    while (jobs.running.load()) {
+        Job *job = takeJob();
+        if (job) {
+            executeJob(job);
+            continue;
+        }
+        jobs.sleepingWorkers.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lock(jobs.sleepLock);
+            while (jobs.queuedJobs.load() <= 0 && jobs.running.load()) {
+                jobs.wake.wait(lock);
+            }
+        }
+        jobs.sleepingWorkers.fetch_sub(1);
+    }
+}
+
+void startJobSystem(int workerCount) {
+    currentJobThread();
+    jobs.running = true;
+    for (int i = 0; i < workerCount; i++) {
+        jobs.workers.push_back(std::thread(jobWorkerLoop));
+    }
+}
+
+void stopJobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(jobs.sleepLock);
+        jobs.running = false;
+        jobs.wake.notify_all();
+    }
+    for (size_t i = 0; i < jobs.workers.size(); i++) {
+        jobs.workers[i].join();
+    }
+    jobs.workers.clear();
+
+    // No thread is submitting now; give back the indices and pools
+    int count = std::min(jobs.threadCount.load(), MAX_JOB_THREADS);
+    for (int i = 0; i < count; i++) {
+        delete[] jobs.deques[i].pool;
+        jobs.deques[i].pool = 0;
+    }
+    jobs.threadCount = 0;
+    jobs.queuedJobs = 0;
+    jobs.generation.fetch_add(1, std::memory_order_release);
+}
+
+// Leaves room for the main and simulation threads in MAX_JOB_THREADS
+int defaultWorkerCount() {
+    int workers = settings.workerThreads;
+    if (workers <= 0) {
+        int hardware = (int)std::thread::hardware_concurrency();
+        workers = hardware > 1 ? hardware - 1 : 1;
+    }
+    return std::min(workers, MAX_JOB_THREADS - SUBMITTING_THREADS);
+}
+
+struct ParallelFor {
+    void (*body)(void *context, int begin, int end);
+    void *context;
+    int grain;
+};
+
+void parallelForJob(Job *job) {
+    ParallelFor *loop = (ParallelFor *)job->context;
+    if (job->end - job->begin <= loop->grain) {
+        loop->body(loop->context, job->begin, job->end);
+        return;
+    }
+    int mid = job->begin + (job->end - job->begin) / 2;
+    Job *left = createJob(parallelForJob, loop, job);
+    left->begin = job->begin; left->end = mid;
+    Job *right = createJob(parallelForJob, loop, job);
+    right->begin = mid; right->end = job->end;
+    runJob(left);
+    runJob(right);
+}
+
+void parallelFor(int count, int grain, void (*body)(void *, int, int), void *context) {
+    if (count <= grain || !jobs.running.load()) {
+        body(context, 0, count);
+        return;
+    }
+    ParallelFor loop = { body, context, grain };
+    Job *root = createJob(parallelForJob, &loop);
+    root->begin = 0;
+    root->end = count;
+    runJob(root);
+    waitForJob(root);
+}
+
+// ---------------------- Text Rendering Functions ----------------------
+// Draws text at specified coordinates using GLUT bitmap fonts
+// Two sizes: regular (18pt) and small (12pt)
+// Used for menus, score display, instructions
+
+void drawText(float x, float y, const char *text) {
+    glRasterPos2f(x, y);
+    while (*text) {
+        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_18, *text);
+        text++;
+    }
+}
+
+void drawTextSmall(float x, float y, const char *text) {
+    glRasterPos2f(x, y);
+    while (*text) {
+        glutBitmapCharacter(GLUT_BITMAP_HELVETICA_12, *text);
+        text++;
+    }
+}
+
+// ---------------------- Utility Function ----------------------
+// Converts integer to string for ports, file names and arguments
+// Short enough to stay inside std::string's own buffer; the HUD formats
+// into stack buffers with snprintf instead
+
+std::string intToString(int value) {
+    char text[16];
+    std::snprintf(text, sizeof(text), "%d", value);
+    return text;
+}
+
+// ---------------------- Background Durable Writer ----------------------
+// One thread that saves files for the game so it never waits on disk
+// queueDurableWrite() hands over the full new contents of a file;
+// if that file is still queued, the newer contents replace it
+// Each file is written to a temp file, fsync'd, then renamed over the
+// old one, so a crash leaves either the old or the new file, never half
+// queueDurableRemove() deletes a file in the same order, so it also
+// cancels or follows any write of that file still waiting
+// stopDiskWriter() finishes everything queued before returning
+
+struct DurableWrite {
+    std::string path;
+    std::string contents;
+    bool remove;
+};
+
+struct DiskWriter {
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::vector<DurableWrite> pending;
+    bool running;
+} diskWriter;
+
+bool writeFileDurably(const char *path, const std::string &contents) {
+    std::string temp = std::string(path) + ".tmp";
+    FILE *file = std::fopen(temp.c_str(), "wb");
+    if (!file) return false;
+    bool ok = std::fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+    ok = std::fflush(file) == 0 && ok;
+#ifdef _WIN32
+    ok = _commit(_fileno(file)) == 0 && ok;
+#else
+    ok = fsync(fileno(file)) == 0 && ok;
+#endif
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) {
+        std::remove(temp.c_str());
+        return false;
+    }
+#ifdef _WIN32
+    return MoveFileExA(temp.c_str(), path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    if (std::rename(temp.c_str(), path) != 0) return false;
+    const char *slash = std::strrchr(path, '/');
+    std::string parent = slash ? std::string(path, std::max<size_t>(1, slash - path)) : ".";
+    int dir = open(parent.c_str(), O_RDONLY);
+    if (dir >= 0) { // make the rename itself durable
+        fsync(dir);
+        close(dir);
+    }
+    return true;
+#endif
+}
+
+void queueDurableChange(const char *path, const std::string &contents, bool remove) {
+    std::lock_guard<std::mutex> lock(diskWriter.lock);
+    for (size_t i = 0; i < diskWriter.pending.size(); i++) {
+        if (diskWriter.pending[i].path == path) {
+            diskWriter.pending[i].contents = contents;
+            diskWriter.pending[i].remove = remove;
+            return;
+        }
+    }
+    DurableWrite change = { path, contents, remove };
+    diskWriter.pending.push_back(change);
+    diskWriter.wake.notify_one();
+}
+
+void queueDurableWrite(const char *path, const std::string &contents) {
+    queueDurableChange(path, contents, false);
+}
+
+void queueDurableRemove(const char *path) {
+    queueDurableChange(path, std::string(), true);
+}
+
+void diskWriterLoop() {
+    std::unique_lock<std::mutex> lock(diskWriter.lock);
+    while (true) {
+        while (diskWriter.pending.empty() && diskWriter.running) {
+            diskWriter.wake.wait(lock);
+        }
+        if (diskWriter.pending.empty()) return; // stopped with nothing left
+        std::vector<DurableWrite> batch;
+        batch.swap(diskWriter.pending);
+
+        lock.unlock();
+        for (size_t i = 0; i < batch.size(); i++) {
+            const char *path = batch[i].path.c_str();
+            if (batch[i].remove) {
+                std::remove(path);
+            } else if (!writeFileDurably(path, batch[i].contents)) {
+                std::cerr << "Could not save " << batch[i].path << std::endl;
+            }
+        }
+        lock.lock();
+    }
+}
+
+void startDiskWriter() {
+    diskWriter.running = true;
+    diskWriter.thread = std::thread(diskWriterLoop);
+}
+
+void stopDiskWriter() {
+    {
+        std::lock_guard<std::mutex> lock(diskWriter.lock);
+        diskWriter.running = false;
+        diskWriter.wake.notify_one();
+    }
+    if (diskWriter.thread.joinable()) {
+        diskWriter.thread.join();
+    }
+}
+
+// ---------------------- Leaderboard Persistence ----------------------
+// Top 10 finished games: score, seconds played, date and game seed
+// Loaded once at start; "highscore.txt" from older versions is migrated
+// Finished games are ranked on the simulation thread in memory only
+// and handed to the background durable writer
+// Headless benchmark runs turn persistence off
+
+const int LEADERBOARD_SIZE = 10;
+
+struct LeaderboardEntry {
+    int score;
+    int seconds;
+    long long date; // time_t when the game ended
+    unsigned int seed;
+};
+
+// Top scores, best first
+struct Leaderboard {
+    LeaderboardEntry entries[LEADERBOARD_SIZE];
+    int count;
+};
+
+const char *LEADERBOARD_FILE = "leaderboard.txt";
+
+Leaderboard leaderboard;
+int lastRank = 0; // 1-based place of the game that just ended, 0 if none
+bool persistScores = true;
+
+void loadHighScore() {
+    leaderboard.count = 0;
+    std::ifstream file(LEADERBOARD_FILE);
+    if (file.is_open()) {
+        std::string line;
+        while (std::getline(file, line) && leaderboard.count < LEADERBOARD_SIZE) {
+            if (line.empty() || line[0] == '#') continue;
+            std::istringstream in(line);
+            LeaderboardEntry entry;
+            if (in >> entry.score >> entry.seconds >> entry.date >> entry.seed) {
+                leaderboard.entries[leaderboard.count++] = entry;
+            }
+        }
+    } else {
+        std::ifstream legacy("highscore.txt");
+        LeaderboardEntry entry = { 0, 0, 0, 0 };
+        if (legacy >> entry.score && entry.score > 0) {
+            leaderboard.entries[leaderboard.count++] = entry;
+        }
+    }
+    highScore = leaderboard.count > 0 ? leaderboard.entries[0].score : 0;
+}
+
+std::string formatLeaderboard(const Leaderboard &board) {
+    std::ostringstream out;
+    out << "# pacman leaderboard v1: score seconds date seed\n";
+    for (int i = 0; i < board.count; i++) {
+        const LeaderboardEntry &e = board.entries[i];
+        out << e.score << " " << e.seconds << " " << e.date << " " << e.seed << "\n";
+    }
+    return out.str();
+}
+
+// Called on the simulation thread at GAMEOVER/WIN; never touches disk
+void saveHighScore(int finalScore, int seconds, unsigned int seed) {
+    lastRank = 0;
+    if (!persistScores) return;
+
+    LeaderboardEntry entry;
+    entry.score = finalScore;
+    entry.seconds = seconds;
+    entry.date = (long long)time(0);
+    entry.seed = seed;
+
+    int place = leaderboard.count;
+    while (place > 0 && leaderboard.entries[place - 1].score < entry.score) place--;
+    if (place >= LEADERBOARD_SIZE) return;
+
+    int last = std::min(leaderboard.count, LEADERBOARD_SIZE - 1);
+    for (int i = last; i > place; i--) {
+        leaderboard.entries[i] = leaderboard.entries[i - 1];
+    }
+    leaderboard.entries[place] = entry;
+    leaderboard.count = std::min(leaderboard.count + 1, LEADERBOARD_SIZE);
+    lastRank = place + 1;
+    highScore = leaderboard.entries[0].score;
+
+    queueDurableWrite(LEADERBOARD_FILE, formatLeaderboard(leaderboard));
+}
+
+// ---------------------- Render Snapshot & Triple Buffer ----------------------
+// Simulation runs on its own thread and never touches OpenGL
+// After every tick it copies what display() needs into a plain snapshot
+// Three snapshot slots: one being written, one being read, one in between
+// publish() swaps the written slot into the middle and marks it fresh
+// acquire() swaps the fresh middle slot out for the renderer, lock-free
+// Neither side ever waits on the other
+
+struct PacmanView {
+    float x, y;
+    int score, lives;
+};
+
+struct GhostView {
+    float x, y;
+    float r, g, b;
+};
+
+void setGhostColor(GhostView &view, int id) {
+    const GhostProfile &profile = GHOST_ROSTER[id];
+    view.r = profile.r; view.g = profile.g; view.b = profile.b;
+}
+
+struct FrameSnapshot {
+    GameState gameState;
+    int board[ROWS][COLS];
+    PacmanView pacmen[MAX_PLAYERS];
+    int playerCount;
+    GhostView ghosts[MAX_GHOSTS];
+    int ghostCount;
+    int activePowerUp;
+    int score, lives, gameTime;
+    unsigned int inputSeq;
+    Clock::time_point inputStamp;
+    unsigned int inputsHandled;
+    Leaderboard leaderboard;
+    int lastRank;
+};
+
+template <typename T>
+class TripleBuffer {
+public:
+    T &writeSlot() { return slots[back]; }
+
+    void publish() {
+        unsigned prev = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        back = prev & INDEX;
+    }
+
+    const T &acquire() {
+        if (middle.load(std::memory_order_acquire) & FRESH) {
+            unsigned prev = middle.exchange(front, std::memory_order_acq_rel);
+            front = prev & INDEX;
+        }
+        return slots[front];
+    }
+
+private:
+    static const unsigned FRESH = 4;
+    static const unsigned INDEX = 3;
+    T slots[3] = {};
+    std::atomic<unsigned> middle{1};
+    unsigned back = 0;  // owned by the writer
+    unsigned front = 2; // owned by the reader
+};
+
+TripleBuffer<FrameSnapshot> snapshots;
+
+// Game state below is owned by the simulation thread
+std::atomic<bool> simRunning(false);
+std::thread simThread;
+
+// Static screens (everything but PLAYING) have nothing to animate
+// In event-driven mode the sim thread sleeps there until a key arrives
+// --busy-idle keeps the old fixed-rate loop for comparison
+bool eventDrivenIdle = true;
+std::mutex simWakeLock;
+std::condition_variable simWake;
+
+bool isStaticState(GameState state) {
+    return state != PLAYING;
+}
+
+// ---------------------- Gameplay Event Log ----------------------
+// Every gameplay event is appended to "events.bin" for analytics
+// Record: varint(tickDelta << 3 | type), then one varint payload
+//   cell events carry row * COLS + col, GAME_START the seed,
+//   WIN/LOSS the final score
+// Ticks restart at 0 with each GAME_START; deltas are since the last record
+// The simulation thread appends to an in-memory buffer; a background
+// writer swaps it out once a second (or when half full) and appends it
+// to the file, so the game never waits on disk
+// If the writer falls behind, new events are dropped and counted
+// A tick's cell events are batched and appended together when it ends
+// --event-log PATH picks the file, --no-event-log turns it off
+// The file is opened before the writer starts, so enabled is settled
+// before any tick reads it and never changes while the game runs
+
+enum EventType {
+    EV_GAME_START, EV_PELLET, EV_POWER_UP, EV_GHOST_EATEN, EV_LIFE_LOST, EV_WIN, EV_LOSS,
+    EVENT_TYPE_COUNT
+};
+
+const char *eventTypeNames[EVENT_TYPE_COUNT] = {
+    "game_start", "pellet", "power_up", "ghost_eaten", "life_lost", "win", "loss"
+};
+
+const char EVENT_LOG_MAGIC[8] = { 'P', 'A', 'C', 'E', 'V', 'T', '1', '\n' };
+const size_t EVENT_BUFFER_SIZE = 64 * 1024;
+const size_t MAX_EVENT_RECORD = 10; // two 5-byte varints
+
+struct EventLog {
+    std::string path;
+    bool enabled;
+    unsigned char buffers[2][EVENT_BUFFER_SIZE];
+    size_t used[2];
+    int active;            // buffer the simulation appends to
+    unsigned long lastTick;
+    unsigned long dropped;
+    bool running;
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake;
+} eventLog;
+
+inline size_t putVarint(unsigned char *out, uint32_t value) {
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[n++] = (unsigned char)value;
+    return n;
+}
+
+// Caller holds eventLog.lock
+void appendEvent(EventType type, uint32_t payload, unsigned long tick) {
+    size_t &used = eventLog.used[eventLog.active];
+    if (used + MAX_EVENT_RECORD > EVENT_BUFFER_SIZE) {
+        eventLog.dropped++;
+        return;
+    }
+    if (type == EV_GAME_START) eventLog.lastTick = tick;
+    unsigned char *out = eventLog.buffers[eventLog.active] + used;
+    size_t n = putVarint(out, (uint32_t)((tick - eventLog.lastTick) << 3 | type));
+    n += putVarint(out + n, payload);
+    used += n;
+    eventLog.lastTick = tick;
+    if (used > EVENT_BUFFER_SIZE / 2) eventLog.wake.notify_one();
+}
+
+void logEvent(EventType type, uint32_t payload, unsigned long tick) {
+    if (!eventLog.enabled) return;
+    std::lock_guard<std::mutex> lock(eventLog.lock); // only ever held for a swap
+    appendEvent(type, payload, tick);
+}
+
+// A tick's events, collected in the frame arena and logged under one lock
+struct PendingEvent {
+    EventType type;
+    uint32_t payload;
+    unsigned long tick;
+};
+
+typedef FrameVector<PendingEvent> EventBatch;
+
+void logEventBatch(EventBatch &batch) {
+    if (!batch.empty() && eventLog.enabled) {
+        std::lock_guard<std::mutex> lock(eventLog.lock);
+        for (size_t i = 0; i < batch.size(); i++) appendEvent(batch[i].type, batch[i].payload, batch[i].tick);
+    }
+    batch.clear();
+}
+
+void eventLogWriterLoop(FILE *file) {
+    std::unique_lock<std::mutex> lock(eventLog.lock);
+    while (true) {
+        if (eventLog.running) {
+            eventLog.wake.wait_for(lock, std::chrono::seconds(1));
+        }
+        int full = eventLog.active;
+        eventLog.active = 1 - full;
+        bool stopping = !eventLog.running;
+
+        lock.unlock();
+        if (eventLog.used[full] > 0) {
+            std::fwrite(eventLog.buffers[full], 1, eventLog.used[full], file);
+            std::fflush(file);
+            eventLog.used[full] = 0;
+        }
+        lock.lock();
+        if (stopping) break;
+    }
+    std::fclose(file);
+}
+
+void startEventLog() {
+    if (!eventLog.enabled || eventLog.path.empty()) {
+        eventLog.enabled = false;
+        return;
+    }
+    FILE *file = std::fopen(eventLog.path.c_str(), "ab");
+    if (!file) {
+        std::cerr << "Cannot open event log " << eventLog.path << std::endl;
+        eventLog.enabled = false;
+        return;
+    }
+    std::fseek(file, 0, SEEK_END);
+    if (std::ftell(file) == 0) {
+        std::fwrite(EVENT_LOG_MAGIC, 1, sizeof(EVENT_LOG_MAGIC), file);
+    }
+    eventLog.running = true;
+    eventLog.thread = std::thread(eventLogWriterLoop, file);
+}
+
+void stopEventLog() {
+    {
+        std::lock_guard<std::mutex> lock(eventLog.lock);
+        eventLog.running = false;
+        eventLog.wake.notify_one();
+    }
+    if (eventLog.thread.joinable()) {
+        eventLog.thread.join();
+    }
+    if (eventLog.dropped) {
+        std::cerr << "Event log dropped " << eventLog.dropped << " events" << std::endl;
+    }
+}
+
+// ---------------------- Game World ----------------------
+// Everything one game's simulation reads and writes, in one struct
+// "game" is the game on screen, owned by the simulation thread
+// Headless replays run worlds of their own side by side on job threads
+// Only the live world logs events, records replays and ranks scores
+// onEvent lets headless callers watch pellets, deaths and catches;
+// cell is row * COLS + col, actor the roster id of the ghost involved or -1
+// Actors and pickups live in one Archetype table per kind; Pacman rows
+// are player numbers, always MAX_PLAYERS of them
+
+struct World {
+    GameState gameState = MENU;
+    GameState previousState = MENU;
+    int gameTime = 0;
+    int frameCount = 0;
+    int64_t playTime = 0; // 16.16 seconds played, gameTime is its whole seconds
+    int32_t tickError = 0; // 1/simHz units of 16.16 time owed to the clock
+
+    // Every game draws its randomness from one seed chosen at reset,
+    // so a seed plus the inputs reproduces a game
+    unsigned int gameSeed = 0;
+    unsigned int gameRng = 1;
+
+    int board[ROWS][COLS];
+    int totalPellets = 0;
+
+    Archetype<Position, Motion, Steering, PlayerStats> pacmen;
+    int playerCount = 1; // kept across resets; set before starting a game
+
+    // Maze distance from every cell to the nearest Pacman in play and
+    // which one that is, built for the cells in fieldCells (-1 = out)
+    uint16_t playerDistance[ROWS][COLS];
+    uint8_t nearestPlayer[ROWS][COLS];
+    int fieldCells[MAX_PLAYERS];
+    int fieldPlayers = -1; // Pacmen in play when built; -1 before the first
+    int fieldFirst = 0;    // first Pacman in play, for cells none can reach
+
+    // Latest key press applied to Pacman in the same tick it was read
+    // Published with the snapshot so display() can time it to the screen
+    unsigned int appliedInputSeq = 0;
+    Clock::time_point appliedInputStamp;
+
+    Archetype<Position, GhostMind> ghosts;
+    Fixed blinkyX = 0, blinkyY = 0; // Blinky's position at the start of the tick
+
+    Archetype<Cell, Pickup> powerUps;
+    Fixed powerUpTimer = 0;
+    int activePowerUp = -1;
+
+    bool live = false;
+    EventBatch *eventBatch = 0; // set while updateGame() runs on a live world
+    void (*onEvent)(void *context, EventType type, int cell, int actor) = 0;
+    void *eventContext = 0;
+
+    World() {
+        pacmen.resize(MAX_PLAYERS);
+    }
+};
+
+World game;
+
+bool inPlay(const PlayerStats &stats) {
+    return stats.lives > 0;
+}
+
+bool inPlay(const World &w, int player) {
+    return inPlay(w.pacmen.get<PlayerStats>(player));
+}
+
+int totalScore(const World &w) {
+    int total = 0;
+    each<PlayerStats>(w.pacmen, 0, w.playerCount, [&](size_t, const PlayerStats &stats) {
+        total += stats.score;
+    });
+    return total;
+}
+
+int livesLeft(const World &w) {
+    int total = 0;
+    each<PlayerStats>(w.pacmen, 0, w.playerCount, [&](size_t, const PlayerStats &stats) {
+        total += std::max(0, stats.lives);
+    });
+    return total;
+}
+
+// Board cell (row * COLS + col) under a position, -1 off the board
+int boardIndex(Fixed x, Fixed y) {
+    int i = fixedCell(y), j = fixedCell(x);
+    return i >= 0 && i < ROWS && j >= 0 && j < COLS ? i * COLS + j : -1;
+}
+
+// What is on the board at a position; off the board reads as wall
+int boardAt(const World &w, Fixed x, Fixed y) {
+    int cell = boardIndex(x, y);
+    return cell < 0 ? 2 : w.board[cell / COLS][cell % COLS];
+}
+
+void gameEvent(World &w, EventType type, Fixed x, Fixed y, int actor = -1) {
+    int cell = boardIndex(x, y);
+    if (w.live) {
+        PendingEvent event = { type, (uint32_t)cell, (unsigned long)w.frameCount };
+        if (w.eventBatch) w.eventBatch->push_back(event);
+        else logEvent(event.type, event.payload, event.tick);
+    }
+    if (w.onEvent) w.onEvent(w.eventContext, type, cell, actor);
+}
+
+// ---------------------- Board Initialization ----------------------
+// Creates the maze layout with walls around borders
+// Adds internal cross-shaped wall pattern
+// Places pellets in all empty spaces
+// Clears starting positions for Pacman and ghosts
+// Places 4 power-ups in corners
+
+// Border walls and the internal cross; its centre (10,10) stays open
+bool mazeWall(int i, int j) {
+    if (i == 0 || j == 0 || i == ROWS-1 || j == COLS-1) return true; // wall
+    if (i == 10 && j == 10) return false;
+    return (i == 10 && j >= 8 && j <= 12) || (j == 10 && i >= 8 && i <= 12); // internal walls
+}
+
+void initBoard(World &w) {
+    for (int i = 0; i < ROWS; i++) {
+        for (int j = 0; j < COLS; j++) {
+            w.board[i][j] = mazeWall(i, j) ? 2 : 1; // else pellet
+        }
+    }
+    // Clear start positions
+    w.board[1][1] = 0;
+    w.board[ROWS-2][COLS-2] = 0;
+    w.board[ROWS-2][1] = 0;
+    w.board[1][COLS-2] = 0;
+    w.board[10][10] = 0;
+
+    // Add power-ups
+    w.board[3][3] = 3;
+    w.board[3][COLS-4] = 3;
+    w.board[ROWS-4][3] = 3;
+    w.board[ROWS-4][COLS-4] = 3;
+
+    // Recount after start positions and power-ups replaced some pellets
+    w.totalPellets = 0;
+    for (int i = 0; i < ROWS; i++)
+        for (int j = 0; j < COLS; j++)
+            if (w.board[i][j] == 1) w.totalPellets++;
+}
+
+// Settings can place spawns anywhere in 1..18; one inside a wall (for a
+// Pacman, at any player's offset) is reported and put back to default
+bool spawnIsOpen(float x, float y) {
+    return !mazeWall((int)y, (int)x);
+}
+
+bool checkSpawnPoints(const char *where) {
+    bool ok = true;
+    for (int p = 0; p < MAX_PLAYERS; p++) {
+        float x = std::min(settings.pacmanSpawnX + p, (float)(COLS - 2));
+        if (spawnIsOpen(x, settings.pacmanSpawnY)) continue;
+        fprintf(stderr, "%s: pacman.spawn (%g, %g) puts player %d inside a wall\n",
+                where, settings.pacmanSpawnX, settings.pacmanSpawnY, p + 1);
+        settings.pacmanSpawnX = DEFAULT_SETTINGS.pacmanSpawnX;
+        settings.pacmanSpawnY = DEFAULT_SETTINGS.pacmanSpawnY;
+        ok = false;
+        break;
+    }
+    for (int g = 0; g < MAX_GHOSTS; g++) {
+        if (spawnIsOpen(settings.ghostSpawnX[g], settings.ghostSpawnY[g])) continue;
+        fprintf(stderr, "%s: %s spawn (%g, %g) is inside a wall\n",
+                where, GHOST_ROSTER[g].name, settings.ghostSpawnX[g], settings.ghostSpawnY[g]);
+        settings.ghostSpawnX[g] = DEFAULT_SETTINGS.ghostSpawnX[g];
+        settings.ghostSpawnY[g] = DEFAULT_SETTINGS.ghostSpawnY[g];
+        ok = false;
+    }
+    if (!spawnIsOpen(settings.ghostRespawnX, settings.ghostRespawnY)) {
+        fprintf(stderr, "%s: ghost respawn (%g, %g) is inside a wall\n",
+                where, settings.ghostRespawnX, settings.ghostRespawnY);
+        settings.ghostRespawnX = DEFAULT_SETTINGS.ghostRespawnX;
+        settings.ghostRespawnY = DEFAULT_SETTINGS.ghostRespawnY;
+        ok = false;
+    }
+    return ok;
+}
+
+// ---------------------- Ghost Initialization ----------------------
+// Creates 4 ghosts with unique personalities:
+// Blinky (Red): Aggressive direct chaser, fastest
+// Pinky (Pink): Ambusher, tries to cut you off
+// Inky (Cyan): Uses corner strategy relative to Blinky
+// Clyde (Orange): Random/unpredictable movement, slowest
+// Each starts at its configured spawn, by default a different corner
+// Resets every ghost row in place, keeping the count; called again on
+// every life lost. A game always has the four of the roster (resetGame()
+// and loaded saves); only the entity benchmark adds rows, which cycle
+// through them
+
+void initGhosts(World &w) {
+    each<Position, GhostMind>(w.ghosts, [&](size_t row, Position &pos, GhostMind &ghost) {
+        int id = (int)(row % MAX_GHOSTS);
+        pos.x = toFixed(settings.ghostSpawnX[id]); pos.y = toFixed(settings.ghostSpawnY[id]);
+        ghost.speed = toFixed(settings.ghostSpeed[id]);
+        ghost.specialTimer = 0;
+        ghost.rng = nextRandom(w.gameRng) | 1u;
+        ghost.id = (uint8_t)id;
+        ghost.behavior = (uint8_t)id; // each ghost has its own personality
+        ghost.isActive = true;
+    });
+}
+
+// ---------------------- Power-up Initialization ----------------------
+// Creates 4 power-ups at corner positions
+// Mix of invincibility, freeze, and speed power-ups
+// All start as active and available to collect
+
+void initPowerUps(World &w) {
+    w.powerUps.clear();
+
+    w.powerUps.spawn(Cell{3, 3}, Pickup{0, true, 0}); // invincible
+    w.powerUps.spawn(Cell{COLS-4, 3}, Pickup{1, true, 0}); // freeze
+    w.powerUps.spawn(Cell{3, ROWS-4}, Pickup{2, true, 0}); // speed
+    w.powerUps.spawn(Cell{COLS-4, ROWS-4}, Pickup{0, true, 0}); // invincible
+}
+
+// ---------------------- Pacman Rendering ----------------------
+// Draws Pacman as a circular shape with mouth opening
+// Uses 36 segments for smooth circle
+// Changes color to cyan when invincible power-up is active
+// Otherwise player 0 is golden yellow, other players their own color
+// Mouth angle creates the classic Pacman shape
+
+const float PLAYER_COLORS[MAX_PLAYERS][3] = {
+    {1.0f, 0.84f, 0.0f}, {0.3f, 1.0f, 0.3f}, {0.5f, 0.6f, 1.0f}, {1.0f, 1.0f, 1.0f}
+};
+
+void drawPacman(const PacmanView &pacman, int player, int activePowerUp) {
+    const int SEG = 36;
+    const float radius = 0.5f;
+    const float mouthAngle = 40.0f * M_PI / 180.0f;
+
+    if (activePowerUp == 0) {
+        glColor3f(0.0f, 1.0f, 1.0f); // Cyan when invincible
+    } else {
+        glColor3fv(PLAYER_COLORS[player]);
+    }
+
+    glBegin(GL_TRIANGLE_FAN);
+        glVertex2f(pacman.x + 0.5f, pacman.y + 0.5f);
+        for (int i = 0; i <= SEG; ++i) {
+            float theta = i * 2.0f * (float)M_PI / SEG;
+            if (theta > mouthAngle && theta < (2.0f * M_PI - mouthAngle)) {
+                glVertex2f(pacman.x + 0.5f + radius * std::cos(theta),
+                           pacman.y + 0.5f + radius * std::sin(theta));
+            }
+        }
+    glEnd();
+}
+
+// ---------------------- Ghost Rendering ----------------------
+// Draws each ghost as a circle with two white eyes
+// Ghost color changes to dark blue when frozen (power-up active)
+// Otherwise displays in their unique color (red, pink, cyan, orange)
+// Eyes are two small white circles for visual character
+
+void drawGhost(const GhostView &ghost, int activePowerUp) {
+    const int SEG = 20;
+    const float radius = 0.5f;
+
+    if (activePowerUp == 1) {
+        glColor3f(0.3f, 0.3f, 0.5f); // Darker when frozen
+    } else {
+        glColor3f(ghost.r, ghost.g, ghost.b);
+    }
+
+    glBegin(GL_POLYGON);
+    for (int i = 0; i < SEG; i++) {
+        float theta = i * 2.0f * M_PI / SEG;
+        glVertex2f(ghost.x + 0.5f + radius * std::cos(theta),
+                   ghost.y + 0.5f + radius * std::sin(theta));
+    }
+    glEnd();
+
+    // Eyes
+    glColor3f(1.0f, 1.0f, 1.0f);
+    glBegin(GL_POLYGON);
+    for (int i = 0; i < 10; i++) {
+        float theta = i * 2.0f * M_PI / 10;
+        glVertex2f(ghost.x + 0.3f + 0.15f * std::cos(theta),
+                   ghost.y + 0.7f + 0.15f * std::sin(theta));
+    }
+    glEnd();
+
+    glBegin(GL_POLYGON);
+    for (int i = 0; i < 10; i++) {
+        float theta = i * 2.0f * M_PI / 10;
+        glVertex2f(ghost.x + 0.7f + 0.15f * std::cos(theta),
+                   ghost.y + 0.7f + 0.15f * std::sin(theta));
+    }
+    glEnd();
+}
+
+// ---------------------- Board/Maze Rendering ----------------------
+// Draws all board elements based on grid values:
+// Pellets: Small yellow squares that Pacman collects
+// Walls: Purple rectangles forming the maze
+// Power-ups: Magenta circles at special positions
+// Sorts the 20x20 grid into one list per kind in the frame arena, then
+// draws the pellets and the walls as one batch of quads each
+
+void drawQuads(const FrameVector<int> &cells, float inset) {
+    glBegin(GL_QUADS);
+    for (size_t k = 0; k < cells.size(); k++) {
+        float i = (float)(cells[k] / COLS), j = (float)(cells[k] % COLS);
+        glVertex2f(j + inset, i + inset);
+        glVertex2f(j + 1 - inset, i + inset);
+        glVertex2f(j + 1 - inset, i + 1 - inset);
+        glVertex2f(j + inset, i + 1 - inset);
+    }
+    glEnd();
+}
+
+void drawBoard(const int board[ROWS][COLS]) {
+    TRACE_SCOPE("drawBoard");
+    FrameVector<int> pellets, walls, powerUps;
+    pellets.reserve(ROWS * COLS);
+    walls.reserve(ROWS * COLS);
+    powerUps.reserve(ROWS * COLS);
+    for (int i = 0; i < ROWS; i++) {
+        for (int j = 0; j < COLS; j++) {
+            if (board[i][j] == 1) pellets.push_back(i * COLS + j);
+            else if (board[i][j] == 2) walls.push_back(i * COLS + j);
+            else if (board[i][j] == 3) powerUps.push_back(i * COLS + j);
+        }
+    }
+
+    glColor3f(1.0f, 0.9f, 0.4f); // pellets
+    drawQuads(pellets, 0.4f);
+    glColor3f(0.2f, 0.0f, 0.6f); // walls
+    drawQuads(walls, 0.0f);
+    glColor3f(1.0f, 0.0f, 1.0f); // power-ups, magenta
+    for (size_t k = 0; k < powerUps.size(); k++) {
+        int i = powerUps[k] / COLS, j = powerUps[k] % COLS;
+        glBegin(GL_POLYGON);
+        for (int s = 0; s < 20; s++) {
+            float theta = s * 2.0f * M_PI / 20;
+            glVertex2f(j + 0.5f + 0.3f * std::cos(theta),
+                       i + 0.5f + 0.3f * std::sin(theta));
+        }
+        glEnd();
+    }
+}
+
+// ---------------------- Win Condition Check ----------------------
+// Returns true when all pellets are eaten (win condition)
+// Uses the live pellet counter instead of scanning the board every tick
+
+bool allPelletsEaten(const World &w) {
+    return w.totalPellets == 0;
+}
+
+// ---------------------- Pacman Spawn ----------------------
+// Player 0 starts at the configured spawn, (1,1) by default;
+// other players line up to its right along the same row
+// Used at reset, when a player joins, and after a life is lost
+
+void pacmanSpawnPoint(int player, Fixed &x, Fixed &y) {
+    x = toFixed(std::min(settings.pacmanSpawnX + player, (float)(COLS - 2)));
+    y = toFixed(settings.pacmanSpawnY);
+}
+
+void spawnPacman(World &w, int player) {
+    Position &pos = w.pacmen.get<Position>(player);
+    Motion &motion = w.pacmen.get<Motion>(player);
+    Steering &steering = w.pacmen.get<Steering>(player);
+    pacmanSpawnPoint(player, pos.x, pos.y);
+    motion.dirX = 0; motion.dirY = 0;
+    motion.speed = toFixed(settings.pacmanSpeed);
+    steering.queuedDirX = 0; steering.queuedDirY = 0;
+    steering.hasQueuedTurn = false;
+    steering.turnIsFresh = false;
+}
+
+// ---------------------- Game Reset Function ----------------------
+// Reinitializes all game components to starting state
+// Resets board, ghosts, power-ups
+// Repositions every Pacman to its spawn
+// Resets every player's score and lives, and the timers
+// Picks a new game seed that all in-game randomness derives from,
+// or takes one so networked peers start identical games
+// Returns to menu screen
+
+void resetGame(World &w, unsigned int seed) {
+    w.gameSeed = seed;
+    w.gameRng = w.gameSeed | 1u;
+    initBoard(w);
+    w.ghosts.resize(MAX_GHOSTS);
+    initGhosts(w);
+    initPowerUps(w);
+    for (int p = 0; p < MAX_PLAYERS; p++) {
+        spawnPacman(w, p);
+        w.pacmen.get<PlayerStats>(p).score = 0;
+        w.pacmen.get<PlayerStats>(p).lives = settings.startLives;
+    }
+    w.gameTime = 0;
+    w.frameCount = 0;
+    w.playTime = 0;
+    w.tickError = 0;
+    w.powerUpTimer = 0;
+    w.activePowerUp = -1;
+    w.gameState = MENU;
+}
+
+void resetGame(World &w) {
+    resetGame(w, (unsigned int)rand());
+}
+
+// ---------------------- Save Games ----------------------
+// Complete simulation state in one fixed-layout record (GameImage):
+// board, Pacman, ghosts, power-ups, timers, score, lives and RNG state
+// File = 24-byte header (magic, version, size, FNV-1a checksum) + image
+// Loading is one read of the whole file, checks, then a fixup pass:
+// ghost i takes roster entry i for name and color, the image supplies the rest
+// Fixed-width fields, native little-endian byte order; positions,
+// speeds and timers are the simulation's own 16.16 values
+// V saves while playing or paused; R on the menu resumes the saved game
+// A game still in progress is saved at exit, a finished one is removed
+// Writes go through the background durable writer
+
+const uint32_t SAVE_VERSION = 5; // 2: one record per player, 3: per-player score and lives, 4: fixed point, 5: tick error
+const char SAVE_MAGIC[8] = { 'P', 'A', 'C', 'S', 'A', 'V', 'E', 0 };
+const int MAX_SAVED_POWER_UPS = 8;
+
+std::string savePath = "savegame.bin";
+
+struct SavedPacman {
+    Fixed x, y, speed;
+    int32_t dirX, dirY, queuedDirX, queuedDirY;
+    int32_t score, lives;
+    uint8_t hasQueuedTurn, pad[3];
+};
+
+struct SavedGhost {
+    Fixed x, y, speed, specialTimer;
+    int32_t behavior;
+    uint32_t rng;
+    uint8_t isActive, pad[3];
+};
+
+struct SavedPowerUp {
+    int32_t x, y;
+    Fixed duration;
+    int32_t type;
+    uint8_t active, pad[3];
+};
+
+struct GameImage {
+    int32_t gameState, previousState;
+    int32_t board[ROWS][COLS];
+    int32_t playerCount;
+    SavedPacman pacmen[MAX_PLAYERS];
+    int32_t ghostCount;
+    SavedGhost ghosts[MAX_GHOSTS];
+    int32_t powerUpCount;
+    SavedPowerUp powerUps[MAX_SAVED_POWER_UPS];
+    Fixed powerUpTimer;
+    int32_t activePowerUp;
+    int32_t gameTime, frameCount, totalPellets;
+    uint32_t gameSeed, gameRng;
+    int32_t tickError;
+    int64_t playTime;
+};
+
+struct SaveFile {
+    char magic[8];
+    uint32_t version;
+    uint32_t imageSize;
+    uint32_t checksum;
+    uint32_t reserved;
+    GameImage image;
+};
+
+static_assert(std::is_trivially_copyable<SaveFile>::value, "save files are raw copies");
+
+uint32_t fnv1a(const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+void captureGameImage(const World &w, GameImage &image) {
+    std::memset(&image, 0, sizeof(image)); // padding too, for the checksum
+    image.gameState = w.gameState;
+    image.previousState = w.previousState;
+    std::memcpy(image.board, w.board, sizeof(w.board));
+    image.playerCount = w.playerCount;
+    each<Position, Motion, Steering, PlayerStats>(w.pacmen, [&](size_t p, const Position &pos,
+            const Motion &motion, const Steering &steering, const PlayerStats &stats) {
+        SavedPacman &saved = image.pacmen[p];
+        saved.x = pos.x; saved.y = pos.y; saved.speed = motion.speed;
+        saved.dirX = motion.dirX; saved.dirY = motion.dirY;
+        saved.queuedDirX = steering.queuedDirX; saved.queuedDirY = steering.queuedDirY;
+        saved.score = stats.score; saved.lives = stats.lives;
+        saved.hasQueuedTurn = steering.hasQueuedTurn;
+    });
+
+    image.ghostCount = (int32_t)std::min(w.ghosts.size(), (size_t)MAX_GHOSTS);
+    each<Position, GhostMind>(w.ghosts, 0, image.ghostCount, [&](size_t i, const Position &pos, const GhostMind &ghost) {
+        SavedGhost &saved = image.ghosts[i];
+        saved.x = pos.x; saved.y = pos.y;
+        saved.speed = ghost.speed; saved.specialTimer = ghost.specialTimer;
+        saved.behavior = ghost.behavior;
+        saved.rng = ghost.rng;
+        saved.isActive = ghost.isActive;
+    });
+    image.powerUpCount = (int32_t)std::min(w.powerUps.size(), (size_t)MAX_SAVED_POWER_UPS);
+    each<Cell, Pickup>(w.powerUps, 0, image.powerUpCount, [&](size_t i, const Cell &cell, const Pickup &pickup) {
+        SavedPowerUp &saved = image.powerUps[i];
+        saved.x = cell.x; saved.y = cell.y;
+        saved.duration = pickup.duration;
+        saved.type = pickup.type;
+        saved.active = pickup.active;
+    });
+
+    image.powerUpTimer = w.powerUpTimer;
+    image.activePowerUp = w.activePowerUp;
+    image.gameTime = w.gameTime; image.frameCount = w.frameCount;
+    image.totalPellets = w.totalPellets;
+    image.gameSeed = w.gameSeed; image.gameRng = w.gameRng;
+    image.playTime = w.playTime;
+    image.tickError = w.tickError;
+}
+
+bool validDirection(int dirX, int dirY) {
+    return dirX >= -1 && dirX <= 1 && dirY >= -1 && dirY <= 1 && (dirX == 0 || dirY == 0);
+}
+
+bool gameImageIsSane(const GameImage &image) {
+    if (image.gameState < MENU || image.gameState > HIGHSCORE) return false;
+    if (image.previousState < MENU || image.previousState > HIGHSCORE) return false;
+    if (image.activePowerUp < -1 || image.activePowerUp > 2) return false;
+    if (image.ghostCount != MAX_GHOSTS) return false; // the roster every game starts with
+    if (image.powerUpCount < 0 || image.powerUpCount > MAX_SAVED_POWER_UPS) return false;
+    for (int i = 0; i < ROWS; i++)
+        for (int j = 0; j < COLS; j++)
+            if (image.board[i][j] < 0 || image.board[i][j] > 3) return false;
+    if (image.playerCount < 1 || image.playerCount > MAX_PLAYERS) return false;
+    if (image.tickError <= -settings.simHz || image.tickError >= settings.simHz) return false;
+    for (int p = 0; p < MAX_PLAYERS; p++) {
+        const SavedPacman &pac = image.pacmen[p];
+        if (!(pac.x >= 0 && pac.x < intToFixed(COLS) && pac.y >= 0 && pac.y < intToFixed(ROWS))) return false;
+        if (pac.lives < 0) return false;
+        if (!validDirection(pac.dirX, pac.dirY) || !validDirection(pac.queuedDirX, pac.queuedDirY)) return false;
+    }
+    for (int i = 0; i < image.powerUpCount; i++) {
+        if (image.powerUps[i].type < 0 || image.powerUps[i].type > 2) return false;
+    }
+    for (int i = 0; i < image.ghostCount; i++) {
+        const SavedGhost &g = image.ghosts[i];
+        if (!(g.x >= 0 && g.x < intToFixed(COLS) && g.y >= 0 && g.y < intToFixed(ROWS))) return false;
+        if (g.behavior < 0 || g.behavior > 3) return false;
+    }
+    return true;
+}
+
+void applyGameImage(World &w, const GameImage &image) {
+    w.ghosts.resize(MAX_GHOSTS); // as resetGame(); initGhosts() keeps it
+    each<Position, GhostMind>(w.ghosts, [&](size_t i, Position &pos, GhostMind &ghost) {
+        const SavedGhost &saved = image.ghosts[i];
+        ghost.id = (uint8_t)i; // fixup: names and colors come from the roster
+        pos.x = saved.x; pos.y = saved.y;
+        ghost.speed = saved.speed; ghost.specialTimer = saved.specialTimer;
+        ghost.behavior = (uint8_t)saved.behavior;
+        ghost.rng = saved.rng;
+        ghost.isActive = saved.isActive != 0;
+    });
+    w.powerUps.resize(image.powerUpCount);
+    each<Cell, Pickup>(w.powerUps, [&](size_t i, Cell &cell, Pickup &pickup) {
+        const SavedPowerUp &saved = image.powerUps[i];
+        cell = Cell{ saved.x, saved.y };
+        pickup = Pickup{ saved.type, saved.active != 0, saved.duration };
+    });
+
+    w.gameState = (GameState)image.gameState;
+    w.previousState = (GameState)image.previousState;
+    std::memcpy(w.board, image.board, sizeof(w.board));
+    w.playerCount = image.playerCount;
+    each<Position, Motion, Steering, PlayerStats>(w.pacmen, [&](size_t p, Position &pos,
+            Motion &motion, Steering &steering, PlayerStats &stats) {
+        const SavedPacman &saved = image.pacmen[p];
+        pos.x = saved.x; pos.y = saved.y; motion.speed = saved.speed;
+        motion.dirX = saved.dirX; motion.dirY = saved.dirY;
+        steering.queuedDirX = saved.queuedDirX; steering.queuedDirY = saved.queuedDirY;
+        stats.score = saved.score; stats.lives = saved.lives;
+        steering.hasQueuedTurn = saved.hasQueuedTurn != 0;
+        steering.turnIsFresh = false;
+    });
+    w.powerUpTimer = image.powerUpTimer;
+    w.activePowerUp = image.activePowerUp;
+    w.gameTime = image.gameTime; w.frameCount = image.frameCount;
+    w.totalPellets = image.totalPellets;
+    w.gameSeed = image.gameSeed; w.gameRng = image.gameRng;
+    w.playTime = image.playTime;
+    w.tickError = image.tickError;
+}
+
+void saveGame(const std::string &path) {
+    SaveFile file;
+    std::memset(&file, 0, sizeof(file));
+    std::memcpy(file.magic, SAVE_MAGIC, sizeof(SAVE_MAGIC));
+    file.version = SAVE_VERSION;
+    file.imageSize = sizeof(GameImage);
+    captureGameImage(game, file.image);
+    file.checksum = fnv1a(&file.image, sizeof(file.image));
+    queueDurableWrite(path.c_str(), std::string((const char *)&file, sizeof(file)));
+}
+
+bool loadGame(const std::string &path) {
+    FILE *in = std::fopen(path.c_str(), "rb");
+    if (!in) return false;
+    SaveFile file;
+    size_t got = std::fread(&file, 1, sizeof(file), in);
+    bool longer = std::fgetc(in) != EOF;
+    std::fclose(in);
+
+    const char *problem = 0;
+    if (got < 16 || std::memcmp(file.magic, SAVE_MAGIC, sizeof(SAVE_MAGIC)) != 0) {
+        problem = "not a save game";
+    } else if (file.version != SAVE_VERSION) {
+        problem = "saved by a different version";
+    } else if (got != sizeof(file) || longer || file.imageSize != sizeof(GameImage)) {
+        problem = "wrong size";
+    } else if (file.checksum != fnv1a(&file.image, sizeof(file.image))) {
+        problem = "checksum mismatch";
+    } else if (!gameImageIsSane(file.image)) {
+        problem = "state out of range";
+    }
+    if (problem) {
+        std::cerr << "Cannot load " << path << ": " << problem << std::endl;
+        return false;
+    }
+    applyGameImage(game, file.image);
+    return true;
+}
+
+bool gameInProgress(const World &w) {
+    return w.gameState == PLAYING || w.gameState == PAUSED ||
+           (w.gameState == MENU && w.previousState == PAUSED);
+}
+
+// Called at exit once the simulation thread has stopped
+// The removal goes through the writer too, after any V-save still queued
+void saveOrClearOnExit() {
+    if (gameInProgress(game)) {
+        saveGame(savePath);
+    } else {
+        queueDurableRemove(savePath.c_str());
+    }
+}
+
+// ---------------------- Replay Recording ----------------------
+// --record DIR writes every game as a replay file for offline analysis
+// A replay is the settings, the starting GameImage and every turn key
+// with the tick it was pressed on; the deterministic simulation
+// reproduces the rest, so a whole game is a few kilobytes
+// Record: varint(tickDelta << 4 | player << 2 | direction),
+//   direction up/down/left/right = 0..3
+// Built in memory on the simulation thread and handed to the durable
+// writer when the game ends, a new one starts, or the program exits
+// FNV-1a checksum over everything after the header's checksum field
+
+const char REPLAY_MAGIC[8] = { 'P', 'A', 'C', 'R', 'P', 'L', '6', '\n' };
+const int TURN_DIRS[4][2] = { {0, 1}, {0, -1}, {-1, 0}, {1, 0} };
+
+struct ReplayHeader {
+    char magic[8];
+    uint32_t checksum;
+    uint32_t settingsSize;
+    uint32_t imageSize;
+    Fixed dt;            // 16.16 seconds per tick
+    uint32_t endFrame;   // frameCount when recording stopped
+    uint32_t inputCount;
+    int32_t endScore, endLives, endState; // to check the replay stays in sync
+    Settings settings;
+    GameImage start;
+};
+
+static_assert(std::is_trivially_copyable<ReplayHeader>::value, "replay headers are raw copies");
+
+const size_t REPLAY_RESERVE = 64 * 1024; // hours of turns after the header
+const size_t REPLAY_HEADROOM = 1024;     // kept free between ticks
+
+struct ReplayRecorder {
+    std::string dir; // empty when not recording
+    bool recording;
+    std::string data;
+    int lastFrame;
+    uint32_t inputs;
+    unsigned long written;
+} replayRecorder;
+
+void finishReplay(const World &w) {
+    ReplayRecorder &rec = replayRecorder;
+    if (!rec.recording) return;
+    rec.recording = false;
+
+    ReplayHeader *header = (ReplayHeader *)&rec.data[0];
+    header->endFrame = (uint32_t)w.frameCount;
+    header->inputCount = rec.inputs;
+    header->endScore = totalScore(w);
+    header->endLives = livesLeft(w);
+    header->endState = w.gameState;
+    size_t skip = offsetof(ReplayHeader, checksum) + sizeof(header->checksum);
+    header->checksum = fnv1a(rec.data.data() + skip, rec.data.size() - skip);
+
+    char name[96];
+    std::snprintf(name, sizeof(name), "/replay-%lld-%08x-%lu.rpl",
+                  (long long)time(0), w.gameSeed, rec.written++);
+    queueDurableWrite((rec.dir + name).c_str(), rec.data);
+}
+
+// Starts recording from the world's current state; ends any open replay
+void startReplay(const World &w) {
+    ReplayRecorder &rec = replayRecorder;
+    if (rec.dir.empty()) return;
+    finishReplay(w);
+
+    ReplayHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, REPLAY_MAGIC, sizeof(REPLAY_MAGIC));
+    header.settingsSize = sizeof(Settings);
+    header.imageSize = sizeof(GameImage);
+    header.dt = tickFixed();
+    header.settings = settings;
+    captureGameImage(w, header.start);
+
+    rec.data.reserve(REPLAY_RESERVE); // turns append without reallocating
+    rec.data.assign((const char *)&header, sizeof(header));
+    rec.lastFrame = w.frameCount;
+    rec.inputs = 0;
+    rec.recording = true;
+}
+
+void startRecording(const std::string &dir) {
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0755);
+#endif
+    replayRecorder.dir = dir;
+}
+
+void recordTurn(const World &w, int player, int dirX, int dirY) {
+    ReplayRecorder &rec = replayRecorder;
+    if (!rec.recording) return;
+    uint32_t dir = 0;
+    while (dir < 3 && (TURN_DIRS[dir][0] != dirX || TURN_DIRS[dir][1] != dirY)) dir++;
+
+    unsigned char out[5];
+    size_t n = putVarint(out, (uint32_t)(w.frameCount - rec.lastFrame) << 4 | player << 2 | dir);
+    rec.data.append((const char *)out, n);
+    rec.lastFrame = w.frameCount;
+    rec.inputs++;
+}
+
+// Called between ticks, outside the tick's allocation check, so a replay
+// longer than REPLAY_RESERVE grows there instead of inside a tick
+void reserveReplaySpace() {
+    ReplayRecorder &rec = replayRecorder;
+    if (rec.recording && rec.data.capacity() - rec.data.size() < REPLAY_HEADROOM) {
+        rec.data.reserve(rec.data.capacity() * 2);
+    }
+}
+
+// ---------------------- New Game & Game End ----------------------
+// Resets everything and starts playing; logs the seed so the event log
+// can tell games apart
+// A finished game is logged, each player's score ranked and its replay
+// written out
+
+void startNewGame(World &w, unsigned int seed) {
+    if (w.live) finishReplay(w);
+    resetGame(w, seed);
+    w.gameState = PLAYING;
+    if (w.live) {
+        logEvent(EV_GAME_START, w.gameSeed, 0);
+        startReplay(w);
+    }
+}
+
+void startNewGame(World &w) {
+    startNewGame(w, (unsigned int)rand());
+}
+
+// Ends the game as WIN or GAMEOVER; players who scored go on the leaderboard
+void finishGame(World &w, GameState result) {
+    w.gameState = result;
+    if (w.onEvent) w.onEvent(w.eventContext, result == WIN ? EV_WIN : EV_LOSS, -1, -1);
+    if (!w.live) return;
+    if (w.eventBatch) logEventBatch(*w.eventBatch); // keeps the log in order
+    logEvent(result == WIN ? EV_WIN : EV_LOSS, (uint32_t)totalScore(w), (unsigned long)w.frameCount);
+    int bestRank = 0; // every scoring player is ranked on its own
+    for (int p = 0; p < w.playerCount; p++) {
+        int score = w.pacmen.get<PlayerStats>(p).score;
+        if (score <= 0) continue; // no leaderboard row for nothing
+        saveHighScore(score, w.gameTime, w.gameSeed);
+        if (lastRank && (!bestRank || lastRank < bestRank)) bestRank = lastRank;
+    }
+    lastRank = bestRank;
+    finishReplay(w);
+}
+
+// ---------------------- Player Distance Field ----------------------
+// Ghosts chase whichever Pacman is nearest; instead of every ghost
+// measuring every player, one breadth-first search from all Pacmen in
+// play at once labels each open cell with its nearest one by maze distance
+// Rebuilt only on ticks where a Pacman entered another cell or left play,
+// before the ghosts move; they then share it read-only across job threads
+// With a single Pacman in play there is nothing to choose and no search
+// The search queue is frame arena scratch
+
+const uint16_t FAR_AWAY = 0xFFFF;
+
+void buildDistanceField(World &w) {
+    int *queue = frameArray<int>(ROWS * COLS);
+    int head = 0, tail = 0;
+    std::memset(w.playerDistance, 0xFF, sizeof(w.playerDistance)); // FAR_AWAY
+    for (int p = 0; p < MAX_PLAYERS; p++) {
+        int cell = w.fieldCells[p];
+        if (cell < 0 || w.playerDistance[cell / COLS][cell % COLS] != FAR_AWAY) continue;
+        w.playerDistance[cell / COLS][cell % COLS] = 0;
+        w.nearestPlayer[cell / COLS][cell % COLS] = (uint8_t)p;
+        queue[tail++] = cell;
+    }
+    static const int STEPS[4][2] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1} };
+    while (head < tail) {
+        int cell = queue[head++];
+        int i = cell / COLS, j = cell % COLS;
+        for (int k = 0; k < 4; k++) {
+            int ni = i + STEPS[k][0], nj = j + STEPS[k][1];
+            if (ni < 0 || ni >= ROWS || nj < 0 || nj >= COLS) continue;
+            if (w.board[ni][nj] == 2 || w.playerDistance[ni][nj] != FAR_AWAY) continue;
+            w.playerDistance[ni][nj] = (uint16_t)(w.playerDistance[i][j] + 1);
+            w.nearestPlayer[ni][nj] = w.nearestPlayer[i][j];
+            queue[tail++] = ni * COLS + nj;
+        }
+    }
+}
+
+void updateDistanceField(World &w) {
+    bool moved = w.fieldPlayers < 0;
+    int players = 0, first = -1;
+    for (int p = 0; p < MAX_PLAYERS; p++) {
+        const Position &pos = w.pacmen.get<Position>(p);
+        int cell = p < w.playerCount && inPlay(w, p) ? boardIndex(pos.x, pos.y) : -1;
+        if (cell >= 0) {
+            players++;
+            if (first < 0) first = p;
+        }
+        if (cell != w.fieldCells[p]) moved = true;
+        w.fieldCells[p] = cell;
+    }
+    if (!moved) return;
+    w.fieldPlayers = players;
+    w.fieldFirst = first < 0 ? 0 : first;
+    if (players > 1) {
+        TRACE_SCOPE("distanceField");
+        buildDistanceField(w);
+    }
+}
+
+// ---------------------- Ghost AI & Movement Logic ----------------------
+// Implements 4 different AI behaviors:
+// Behavior 0 (Blinky): Direct chase - targets Pacman's current position
+// Behavior 1 (Pinky): Ambush - targets 4 cells ahead of Pacman
+// Behavior 2 (Inky): Corner - uses Blinky's position to flank
+// Behavior 3 (Clyde): Random - picks random targets periodically
+// Ghosts freeze when freeze power-up is active
+// Ghost speed gradually increases over time for difficulty
+// Collision detection with walls prevents ghost movement through barriers
+// Reads only shared state fixed for the tick, so ghosts update in parallel
+// Movement and timers scale with dt (16.16 seconds this tick), all in
+// integer math; direction is normalized with an integer square root
+// With several players each ghost hunts the Pacman closest to it
+// through the maze, looked up in the shared distance field
+
+int nearestPacman(const World &w, Fixed x, Fixed y) {
+    int cell = boardIndex(x, y);
+    if (w.fieldPlayers > 1 && cell >= 0 && w.playerDistance[cell / COLS][cell % COLS] != FAR_AWAY) {
+        return w.nearestPlayer[cell / COLS][cell % COLS];
+    }
+    return w.fieldFirst;
+}
+
+// speedup is settings.ghostSpeedup over dt, converted once per tick
+void updateGhost(const World &w, Position &pos, GhostMind &ghost, Fixed dt, Fixed speedup) {
+    if (w.activePowerUp == 1) return; // Frozen
+
+    ghost.specialTimer += dt;
+
+    // Increase speed over time: ramps up for one second every speedup period
+    if (w.gameTime % settings.speedupPeriod == 0 && w.gameTime > 0) {
+        ghost.speed += speedup;
+    }
+
+    int player = nearestPacman(w, pos.x, pos.y);
+    const Position &pacman = w.pacmen.get<Position>(player);
+    const Motion &heading = w.pacmen.get<Motion>(player);
+    Fixed targetX = pacman.x;
+    Fixed targetY = pacman.y;
+
+    // Different behaviors
+    if (ghost.behavior == 0) { // Blinky - Direct chase
+        targetX = pacman.x;
+        targetY = pacman.y;
+    } else if (ghost.behavior == 1) { // Pinky - Ambush (ahead of pacman)
+        targetX = pacman.x + intToFixed(heading.dirX * 4);
+        targetY = pacman.y + intToFixed(heading.dirY * 4);
+    } else if (ghost.behavior == 2) { // Inky - Try to corner
+        targetX = pacman.x + (pacman.x - w.blinkyX);
+        targetY = pacman.y + (pacman.y - w.blinkyY);
+    } else if (ghost.behavior == 3) { // Clyde - Random movement
+        if (fixedCell(ghost.specialTimer) % 5 == 0) {
+            targetX = intToFixed((int)(nextRandom(ghost.rng) % COLS));
+            targetY = intToFixed((int)(nextRandom(ghost.rng) % ROWS));
+        }
+    }
+
+    // Move toward target
+    Fixed dx = targetX - pos.x;
+    Fixed dy = targetY - pos.y;
+    Fixed dist = (Fixed)isqrt64((uint64_t)((int64_t)dx * dx + (int64_t)dy * dy));
+
+    if (dist > 0) {
+        Fixed step = std::min(fixedMul(ghost.speed, dt), MAX_STEP);
+        Fixed scale = (Fixed)(((int64_t)step << FIXED_SHIFT) / dist); // step / dist
+        Fixed nextX = pos.x + fixedMul(dx, scale);
+        Fixed nextY = pos.y + fixedMul(dy, scale);
+
+        if (boardAt(w, nextX, nextY) != 2) {
+            pos.x = nextX;
+            pos.y = nextY;
+        }
+    }
+}
+
+// ---------------------- Movement Helper ----------------------
+// True when one step of the given size in (dirX, dirY) stays out of walls
+// Same whole-cell lookup the movement code has always used; steps are
+// capped under a cell (MAX_STEP) so none can pass through a wall
+
+bool canMove(const World &w, Fixed x, Fixed y, int dirX, int dirY, Fixed step) {
+    return boardAt(w, x + dirX * step, y + dirY * step) != 2;
+}
+
+// Ghost updates go through the job system; a handful run inline,
+// large ghost counts split into GHOST_GRAIN-sized jobs
+const int GHOST_GRAIN = 64;
+
+struct GhostTick {
+    World *world;
+    Fixed dt, speedup;
+};
+
+void updateGhostRange(void *context, int begin, int end) {
+    const GhostTick *tick = (const GhostTick *)context;
+    World &w = *tick->world;
+    countMetric(M_GHOST_UPDATES, end - begin);
+    each<Position, GhostMind>(w.ghosts, begin, end, [&](size_t i, Position &pos, GhostMind &ghost) {
+        TRACE_SCOPE("updateGhost", (int)i);
+        updateGhost(w, pos, ghost, tick->dt, tick->speedup);
+    });
+}
+
+// ---------------------- Main Game Update Loop ----------------------
+// Only runs when game state is PLAYING
+// Advances by dt (16.16 seconds) plus the rounding error it carries;
+// tick counter and play time tracking
+// Every Pacman in play moves in player order, scoring for itself
+// Queued turn applied once the cell in that direction is open
+// Pacman movement with wall collision detection
+// Pellet collection and scoring (+10 points per pellet)
+// Power-up collection and activation (+50 points), power-ups in row order
+// Power-up timer countdown (5 second duration)
+// Speed boost application/removal for speed power-up
+// Refreshes the distance field, then updates all ghost positions using
+// AI, through the job system
+// Collision detection between each Pacman in play and the ghosts:
+//   - With invincibility: Ghost respawns, +100 points to that player
+//   - Without: that player loses a life and respawns, or is out when
+//     none are left; the game is over once every player is out
+// Win condition check when all pellets eaten
+// Each step is a system over the component columns it names, run in
+// the order above
+// Scratch memory comes from the frame arena and is released on return;
+// events are logged together at the end
+
+// Movement system: each Pacman in play takes its queued turn and moves
+void movePacmen(World &w, Fixed dt) {
+    each<Position, Motion, Steering, PlayerStats>(w.pacmen, 0, w.playerCount, [&](size_t, Position &pos,
+            Motion &motion, Steering &steering, const PlayerStats &stats) {
+        if (!inPlay(stats)) return;
+        Fixed step = std::min(fixedMul(motion.speed, dt), MAX_STEP);
+
+        // Take a queued turn as soon as the maze allows it
+        if (steering.hasQueuedTurn &&
+            canMove(w, pos.x, pos.y, steering.queuedDirX, steering.queuedDirY, step)) {
+            motion.dirX = steering.queuedDirX;
+            motion.dirY = steering.queuedDirY;
+            steering.hasQueuedTurn = false;
+            if (steering.turnIsFresh) {
+                w.appliedInputSeq++;
+                w.appliedInputStamp = steering.queuedStamp;
+            }
+        }
+        steering.turnIsFresh = false;
+
+        // Move Pacman
+        if (canMove(w, pos.x, pos.y, motion.dirX, motion.dirY, step)) {
+            pos.x += motion.dirX * step;
+            pos.y += motion.dirY * step;
+        }
+    });
+}
+
+// Pellet system: the pellet under each Pacman in play
+void eatPellets(World &w) {
+    each<Position, PlayerStats>(w.pacmen, 0, w.playerCount, [&](size_t, const Position &pos, PlayerStats &stats) {
+        if (!inPlay(stats)) return;
+        int cell = boardIndex(pos.x, pos.y);
+        if (cell < 0 || w.board[cell / COLS][cell % COLS] != 1) return;
+        w.board[cell / COLS][cell % COLS] = 0;
+        w.totalPellets--;
+        stats.score += settings.pelletScore;
+        countMetric(M_PELLETS_EATEN);
+        gameEvent(w, EV_PELLET, pos.x, pos.y);
+    });
+}
+
+// Pickup system: a power-up still on the board goes to the first Pacman
+// in play standing on its cell
+void collectPowerUps(World &w) {
+    each<Cell, Pickup>(w.powerUps, [&](size_t, const Cell &cell, Pickup &pickup) {
+        if (!pickup.active || cell.x < 0 || cell.x >= COLS || cell.y < 0 || cell.y >= ROWS) return;
+        if (w.board[cell.y][cell.x] != 3) return;
+        for (int p = 0; p < w.playerCount; p++) {
+            const Position &pos = w.pacmen.get<Position>(p);
+            if (!inPlay(w, p) || boardIndex(pos.x, pos.y) != cell.y * COLS + cell.x) continue;
+            w.board[cell.y][cell.x] = 0;
+            w.activePowerUp = pickup.type;
+            w.powerUpTimer = toFixed(settings.powerUpDuration);
+            pickup.active = false;
+            w.pacmen.get<PlayerStats>(p).score += settings.powerUpScore;
+            countMetric(M_POWER_UPS);
+            gameEvent(w, EV_POWER_UP, pos.x, pos.y);
+
+            if (w.activePowerUp == 2) {
+                w.pacmen.get<Motion>(p).speed = toFixed(settings.pacmanBoostSpeed);
+            }
+            return;
+        }
+    });
+}
+
+// Counts down the active power-up; speed boosts end with it
+void updatePowerUpTimer(World &w, Fixed dt) {
+    if (w.powerUpTimer <= 0) return;
+    w.powerUpTimer -= dt;
+    if (w.powerUpTimer <= 0) {
+        w.activePowerUp = -1;
+        each<Motion>(w.pacmen, 0, w.playerCount, [&](size_t, Motion &motion) {
+            motion.speed = toFixed(settings.pacmanSpeed);
+        });
+    }
+}
+
+// Collision system: every ghost Position against every Pacman in play
+// Returns true when the collision ended the game
+bool collideGhosts(World &w) {
+    const Fixed reach = toFixed(settings.collisionDistance);
+    bool over = false;
+    each<Position, GhostMind>(w.ghosts, [&](size_t, Position &ghostPos, const GhostMind &ghost) {
+        for (int p = 0; p < w.playerCount && !over; p++) {
+            Position &pos = w.pacmen.get<Position>(p);
+            PlayerStats &stats = w.pacmen.get<PlayerStats>(p);
+            if (!inPlay(stats)) continue;
+            if (std::abs(pos.x - ghostPos.x) >= reach || std::abs(pos.y - ghostPos.y) >= reach) continue;
+            countMetric(M_COLLISIONS);
+            if (w.activePowerUp == 0) {
+                // Invincible - ghost respawns
+                gameEvent(w, EV_GHOST_EATEN, ghostPos.x, ghostPos.y, ghost.id);
+                ghostPos.x = toFixed(settings.ghostRespawnX);
+                ghostPos.y = toFixed(settings.ghostRespawnY);
+                stats.score += settings.ghostScore;
+                countMetric(M_GHOSTS_EATEN);
+            } else {
+                // Lose life
+                stats.lives--;
+                countMetric(M_LIVES_LOST);
+                gameEvent(w, EV_LIFE_LOST, pos.x, pos.y, ghost.id);
+                if (inPlay(stats)) pacmanSpawnPoint(p, pos.x, pos.y);
+                initGhosts(w);
+                if (livesLeft(w) == 0) {
+                    finishGame(w, GAMEOVER);
+                    over = true;
+                }
+            }
+        }
+    });
+    return over;
+}
+
+// Sends the tick's batched events to the log when updateGame() returns
+struct TickEvents {
+    World &w;
+    EventBatch events;
+    TickEvents(World &w) : w(w) {
+        if (!w.live) return;
+        events.reserve(16);
+        w.eventBatch = &events;
+    }
+    ~TickEvents() {
+        if (!w.live) return;
+        logEventBatch(events);
+        w.eventBatch = 0;
+    }
+};
+
+// dt is a rounded 1/simHz; the world adds up what rounding left out and
+// pays it back a unit at a time, so simHz ticks make exactly one second
+Fixed carryTickError(World &w, Fixed dt) {
+    w.tickError += FIXED_ONE - dt * settings.simHz;
+    Fixed owed = w.tickError / settings.simHz;
+    w.tickError -= owed * settings.simHz;
+    return dt + owed;
+}
+
+void updateGame(World &w, Fixed dt) {
+    TRACE_SCOPE("updateGame");
+    if (w.gameState != PLAYING) return;
+    FrameArenaScope scratch;
+    TickEvents tickEvents(w);
+
+    w.frameCount++;
+    dt = carryTickError(w, dt);
+    w.playTime += dt;
+    w.gameTime = (int)(w.playTime >> FIXED_SHIFT);
+
+    movePacmen(w, dt);
+    eatPellets(w);
+    collectPowerUps(w);
+    updatePowerUpTimer(w, dt);
+
+    // Move Ghosts
+    updateDistanceField(w);
+    if (!w.ghosts.empty()) {
+        w.blinkyX = w.ghosts.get<Position>(0).x;
+        w.blinkyY = w.ghosts.get<Position>(0).y;
+    }
+    GhostTick ghostTick = { &w, dt, fixedMul(toFixed(settings.ghostSpeedup), dt) };
+    parallelFor((int)w.ghosts.size(), GHOST_GRAIN, updateGhostRange, &ghostTick);
+
+    if (collideGhosts(w)) return;
+
+    // Win check
+    if (allPelletsEaten(w)) {
+        finishGame(w, WIN);
+    }
+}
+
+// ---------------------- Keyboard Input Handler ----------------------
+// Processes all keyboard inputs for game control
+// ESC: Exit game immediately
+// SPACE: Start new game from menu
+// R: Resume game if paused, or the saved game from an earlier run
+// V: Save the game in progress
+// H: Open help screen from menu
+// 2/3/4: Start a local game for that many players from menu
+// S: Open high score screen (also Down movement in-game)
+// M: Return to menu from any screen
+// P: Pause/unpause during gameplay
+// Movement, Up/Left/Down/Right, one set of keys per player:
+//   W/A/S/D, I/J/K/L, T/F/G/H and 8/4/5/6
+// Movement only active during PLAYING state, for players in the game
+// Movement keys queue a turn that updateGame() applies when legal
+// Runs on the simulation thread; keyboard() just queues the press
+
+void queueTurn(World &w, int player, int dirX, int dirY, Clock::time_point stamp) {
+    Steering &steering = w.pacmen.get<Steering>(player);
+    steering.queuedDirX = dirX;
+    steering.queuedDirY = dirY;
+    steering.hasQueuedTurn = true;
+    steering.turnIsFresh = true;
+    steering.queuedStamp = stamp;
+    if (w.live) recordTurn(w, player, dirX, dirY);
+}
+
+struct PlayerBinding {
+    unsigned char up, left, down, right;
+};
+
+const PlayerBinding PLAYER_BINDINGS[MAX_PLAYERS] = {
+    { 'w', 'a', 's', 'd' }, { 'i', 'j', 'k', 'l' }, { 't', 'f', 'g', 'h' }, { '8', '4', '5', '6' }
+};
+
+// Queues the turn if key is one of a playing player's movement keys
+bool handleTurnKey(const InputEvent &event) {
+    unsigned char key = (unsigned char)std::tolower(event.key);
+    for (int p = 0; p < game.playerCount; p++) {
+        const PlayerBinding &keys = PLAYER_BINDINGS[p];
+        if (key == keys.up) queueTurn(game, p, 0, 1, event.stamp);
+        else if (key == keys.down) queueTurn(game, p, 0, -1, event.stamp);
+        else if (key == keys.left) queueTurn(game, p, -1, 0, event.stamp);
+        else if (key == keys.right) queueTurn(game, p, 1, 0, event.stamp);
+        else continue;
+        return true;
+    }
+    return false;
+}
+
+void startLocalGame(int players) {
+    game.playerCount = players;
+    startNewGame(game);
+}
+
+void handleKey(const InputEvent &event) {
+    if (game.gameState == PLAYING && handleTurnKey(event)) return;
+    switch (event.key) {
+        case ' ': // SPACE
+            if (game.gameState == MENU) {
+                startLocalGame(1);
+            }
+            break;
+        case '2': case '3': case '4':
+            if (game.gameState == MENU) {
+                startLocalGame(event.key - '0');
+            }
+            break;
+        case 'r': case 'R':
+            if (game.gameState == MENU && game.previousState == PAUSED) {
+                game.gameState = PLAYING;
+            } else if (game.gameState == MENU && loadGame(savePath)) {
+                game.gameState = PLAYING;
+                startReplay(game);
+            }
+            break;
+        case 'v': case 'V':
+            if (game.gameState == PLAYING || game.gameState == PAUSED) {
+                saveGame(savePath);
+            }
+            break;
+        case 'h': case 'H':
+            if (game.gameState == MENU) {
+                game.gameState = HELP;
+            }
+            break;
+        case 's': case 'S':
+            if (game.gameState == MENU) {
+                game.gameState = HIGHSCORE;
+            }
+            break;
+        case 'm': case 'M':
+            if (game.gameState != PLAYING) {
+                game.gameState = MENU;
+            }
+            break;
+        case 'p': case 'P':
+            if (game.gameState == PLAYING) {
+                game.previousState = PAUSED;
+                game.gameState = PAUSED;
+            } else if (game.gameState == PAUSED) {
+                game.gameState = PLAYING;
+            }
+            break;
+
+            }
+}
+
+void processInput() {
+    InputEvent event;
+    while (inputQueue.pop(event)) {
+        handleKey(event);
+        inputsHandled++;
+    }
+}
+
+// ---------------------- Snapshot Publishing ----------------------
+// Copies the render-visible part of the game into the writer's slot
+// Called on the simulation thread right after each updateGame()
+// Plain copies only, so publishing never allocates or blocks
+
+void publishSnapshot() {
+    FrameSnapshot &snap = snapshots.writeSlot();
+    snap.gameState = game.gameState;
+    std::copy(&game.board[0][0], &game.board[0][0] + ROWS * COLS, &snap.board[0][0]);
+    snap.playerCount = game.playerCount;
+    each<Position, PlayerStats>(game.pacmen, 0, game.playerCount, [&](size_t p, const Position &pos, const PlayerStats &stats) {
+        snap.pacmen[p].x = fixedToFloat(pos.x);
+        snap.pacmen[p].y = fixedToFloat(pos.y);
+        snap.pacmen[p].score = stats.score;
+        snap.pacmen[p].lives = stats.lives;
+    });
+    snap.ghostCount = (int)std::min(game.ghosts.size(), (size_t)MAX_GHOSTS);
+    each<Position, GhostMind>(game.ghosts, 0, snap.ghostCount, [&](size_t i, const Position &pos, const GhostMind &ghost) {
+        GhostView &view = snap.ghosts[i];
+        view.x = fixedToFloat(pos.x); view.y = fixedToFloat(pos.y);
+        setGhostColor(view, ghost.id);
+    });
+    snap.activePowerUp = game.activePowerUp;
+    snap.score = totalScore(game);
+    snap.lives = livesLeft(game);
+    snap.gameTime = game.gameTime;
+    snap.inputSeq = game.appliedInputSeq;
+    snap.inputStamp = game.appliedInputStamp;
+    snap.inputsHandled = inputsHandled;
+    snap.leaderboard = leaderboard;
+    snap.lastRank = lastRank;
+    snapshots.publish();
+
+    setGauge(G_SCORE, snap.score);
+    setGauge(G_LIVES, snap.lives);
+    setGauge(G_PELLETS_LEFT, game.totalPellets);
+    setGauge(G_GAME_STATE, game.gameState);
+}
+
+// ---------------------- Spectator Feed ----------------------
+// --spectators publishes the game to a shared-memory ring that any number
+// of local --spectate processes read; the game never learns about them
+// One record per simulated tick: state, scores, every actor's position and
+// the board cells that changed, as cell << 2 | value
+// A tick changing more cells than a record holds (a new game) also
+// rewrites the keyframe, a full board with its tick, and flags the record;
+// the keyframe is refreshed every SPECTATOR_KEYFRAME ticks anyway so a
+// spectator can join at any time
+// Records and the keyframe are seqlocked: the sequence is cleared while
+// one is rewritten and set after, so readers detect torn copies; their
+// bytes move as relaxed atomic words so a torn copy is never a data race
+// Each game's feed is named after its process id, printed at startup for
+// --spectate PID; spectators also leave a feed whose game has died
+// Cost to the game is the diff against the last board plus one record,
+// whether there are no spectators or a hundred
+
+const uint32_t SPECTATOR_TICKS = 1024; // ~17 s at 60 Hz
+const int SPECTATOR_CHANGES = 12;
+const uint8_t FULL_BOARD = 0xFF;
+const uint32_t SPECTATOR_KEYFRAME = 256;
+const uint32_t SPECTATOR_VERSION = 3; // 2: per-player score and lives, 3: atomic words, host pid
+
+struct ActorPosition {
+    float x, y;
+};
+
+struct SpectatorState {
+    uint8_t gameState, playerCount, ghostCount;
+    uint8_t changeCount;       // FULL_BOARD: see the keyframe
+    int8_t activePowerUp;
+    uint8_t lives[MAX_PLAYERS];
+    uint16_t gameTime;
+    int32_t scores[MAX_PLAYERS];
+    ActorPosition pacmen[MAX_PLAYERS];
+    ActorPosition ghosts[MAX_GHOSTS];
+    uint16_t changes[SPECTATOR_CHANGES];
+};
+
+const size_t STATE_WORDS = sizeof(SpectatorState) / 4;
+const size_t BOARD_WORDS = ROWS * COLS / 4;
+
+struct SpectatorTick {
+    std::atomic<uint32_t> seq; // tick + 1 once written
+    std::atomic<uint32_t> state[STATE_WORDS]; // a SpectatorState
+};
+
+struct SpectatorFeed {
+    char magic[8];
+    uint32_t version, capacity;
+    uint32_t hostPid;
+    std::atomic<uint32_t> open; // cleared when the game exits
+    std::atomic<uint32_t> head; // ticks written so far
+    std::atomic<uint32_t> keySeq; // keyTick + 1 once written
+    std::atomic<uint32_t> keyTick;
+    std::atomic<uint32_t> keyBoard[BOARD_WORDS]; // uint8_t [ROWS][COLS]
+    SpectatorTick ticks[SPECTATOR_TICKS];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "feed atomics are shared between processes");
+static_assert(sizeof(SpectatorState) % 4 == 0 && ROWS * COLS % 4 == 0, "feed copies whole words");
+
+void storeWords(std::atomic<uint32_t> *to, const void *from, size_t words) {
+    const unsigned char *bytes = (const unsigned char *)from;
+    for (size_t i = 0; i < words; i++) {
+        uint32_t word;
+        std::memcpy(&word, bytes + i * 4, 4);
+        to[i].store(word, std::memory_order_relaxed);
+    }
+}
+
+void loadWords(void *to, const std::atomic<uint32_t> *from, size_t words) {
+    unsigned char *bytes = (unsigned char *)to;
+    for (size_t i = 0; i < words; i++) {
+        uint32_t word = from[i].load(std::memory_order_relaxed);
+        std::memcpy(bytes + i * 4, &word, 4);
+    }
+}
+
+uint32_t currentProcessId() {
+#ifdef _WIN32
+    return (uint32_t)GetCurrentProcessId();
+#else
+    return (uint32_t)getpid();
+#endif
+}
+
+bool processAlive(uint32_t pid) {
+#ifdef _WIN32
+    HANDLE process = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)pid);
+    if (!process) return false;
+    bool alive = WaitForSingleObject(process, 0) == WAIT_TIMEOUT;
+    CloseHandle(process);
+    return alive;
+#else
+    return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+#endif
+}
+
+std::string spectatorFeedName(uint32_t hostPid) {
+#ifdef _WIN32
+    return "Local\\pacman-spectate-" + intToString((int)hostPid);
+#else
+    return "/pacman-spectate-" + intToString((int)hostPid);
+#endif
+}
+
+struct SpectatorMapping {
+    SpectatorFeed *feed;
+#ifdef _WIN32
+    HANDLE handle;
+#endif
+};
+
+// The game creates the feed writable; spectators map it read-only
+bool mapSpectatorFeed(SpectatorMapping &map, uint32_t hostPid, bool create) {
+    map.feed = 0;
+    std::string name = spectatorFeedName(hostPid);
+#ifdef _WIN32
+    map.handle = create ?
+        CreateFileMappingA(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE, 0, sizeof(SpectatorFeed), name.c_str()) :
+        OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+    if (!map.handle) return false;
+    map.feed = (SpectatorFeed *)MapViewOfFile(map.handle, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, sizeof(SpectatorFeed));
+    if (!map.feed) CloseHandle(map.handle);
+#else
+    int fd = shm_open(name.c_str(), create ? O_CREAT | O_RDWR : O_RDONLY, 0644);
+    if (fd < 0) return false;
+    if (create && ftruncate(fd, sizeof(SpectatorFeed)) != 0) {
+        close(fd);
+        return false;
+    }
+    void *view = mmap(0, sizeof(SpectatorFeed), create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view != MAP_FAILED) map.feed = (SpectatorFeed *)view;
+#endif
+    return map.feed != 0;
+}
+
+void unmapSpectatorFeed(SpectatorMapping &map) {
+    if (!map.feed) return;
+#ifdef _WIN32
+    UnmapViewOfFile(map.feed);
+    CloseHandle(map.handle);
+#else
+    munmap(map.feed, sizeof(SpectatorFeed));
+#endif
+    map.feed = 0;
+}
+
+struct SpectatorWriter {
+    SpectatorMapping map;
+    uint32_t tick;
+    int board[ROWS][COLS]; // as of the last record
+    SpectatorState record; // built here, then copied into the ring
+} spectatorWriter;
+
+bool startSpectatorFeed() {
+    SpectatorWriter &writer = spectatorWriter;
+    uint32_t pid = currentProcessId();
+    if (!mapSpectatorFeed(writer.map, pid, true)) {
+        std::cerr << "Cannot create the spectator feed" << std::endl;
+        return false;
+    }
+    SpectatorFeed &feed = *writer.map.feed;
+    feed.open.store(0);
+    feed.head.store(0);
+    feed.keySeq.store(0);
+    std::memcpy(feed.magic, "PACSPEC1", 8);
+    feed.version = SPECTATOR_VERSION;
+    feed.capacity = SPECTATOR_TICKS;
+    feed.hostPid = pid;
+    for (uint32_t i = 0; i < SPECTATOR_TICKS; i++) feed.ticks[i].seq.store(0);
+    writer.tick = 0;
+    feed.open.store(1, std::memory_order_release);
+    return true;
+}
+
+void stopSpectatorFeed() {
+    SpectatorWriter &writer = spectatorWriter;
+    if (!writer.map.feed) return;
+    writer.map.feed->open.store(0, std::memory_order_release);
+    unmapSpectatorFeed(writer.map);
+#ifndef _WIN32
+    shm_unlink(spectatorFeedName(currentProcessId()).c_str());
+#endif
+}
+
+void writeKeyframe(SpectatorFeed &feed, uint32_t tick, const int board[ROWS][COLS]) {
+    feed.keySeq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    feed.keyTick.store(tick, std::memory_order_relaxed);
+    uint8_t cells[ROWS][COLS];
+    for (int i = 0; i < ROWS; i++)
+        for (int j = 0; j < COLS; j++)
+            cells[i][j] = (uint8_t)board[i][j];
+    storeWords(feed.keyBoard, cells, BOARD_WORDS);
+    feed.keySeq.store(tick + 1, std::memory_order_release);
+}
+
+// Called once per simulated tick; a no-op without --spectators
+void writeSpectatorTick(const World &w) {
+    SpectatorWriter &writer = spectatorWriter;
+    if (!writer.map.feed) return;
+    SpectatorFeed &feed = *writer.map.feed;
+    uint32_t tick = writer.tick++;
+    SpectatorTick &slot = feed.ticks[tick % SPECTATOR_TICKS];
+    SpectatorState &record = writer.record;
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // Whole rows compare with memcmp; most ticks change a cell or none
+    int changed = 0;
+    for (int i = 0; i < ROWS; i++) {
+        if (tick != 0 && std::memcmp(w.board[i], writer.board[i], sizeof(w.board[i])) == 0) continue;
+        for (int j = 0; j < COLS; j++) {
+            int value = w.board[i][j];
+            if (value == writer.board[i][j] && tick != 0) continue;
+            writer.board[i][j] = value;
+            if (changed < SPECTATOR_CHANGES) record.changes[changed] = (uint16_t)((i * COLS + j) << 2 | value);
+            changed++;
+        }
+    }
+    record.changeCount = changed > SPECTATOR_CHANGES ? FULL_BOARD : (uint8_t)changed;
+    if (record.changeCount == FULL_BOARD || tick % SPECTATOR_KEYFRAME == 0) writeKeyframe(feed, tick, writer.board);
+
+    record.gameState = (uint8_t)w.gameState;
+    record.playerCount = (uint8_t)w.playerCount;
+    record.ghostCount = (uint8_t)std::min(w.ghosts.size(), (size_t)MAX_GHOSTS);
+    record.activePowerUp = (int8_t)w.activePowerUp;
+    record.gameTime = (uint16_t)w.gameTime;
+    each<Position, PlayerStats>(w.pacmen, 0, w.playerCount, [&](size_t p, const Position &pos, const PlayerStats &stats) {
+        record.pacmen[p].x = fixedToFloat(pos.x);
+        record.pacmen[p].y = fixedToFloat(pos.y);
+        record.scores[p] = stats.score;
+        record.lives[p] = (uint8_t)std::max(0, std::min(stats.lives, 255));
+    });
+    each<Position>(w.ghosts, 0, record.ghostCount, [&](size_t i, const Position &pos) {
+        record.ghosts[i].x = fixedToFloat(pos.x);
+        record.ghosts[i].y = fixedToFloat(pos.y);
+    });
+    storeWords(slot.state, &record, STATE_WORDS);
+    slot.seq.store(tick + 1, std::memory_order_release);
+    feed.head.store(tick + 1, std::memory_order_release);
+}
+
+// ---------------------- Simulation Thread ----------------------
+// Fixed-step loop at the configured sim rate driven by the monotonic clock
+// Runs as many ticks of dt as real time has advanced, then publishes
+// Drains the input queue at the start of every tick
+// Schedules against absolute tick times so render stalls never slow it
+// If it falls far behind (debugger, suspend) it resyncs instead of bursting
+// On static screens it blocks until keyboard() wakes it, then restarts
+// its clock so the idle time is not simulated
+// Stopped and joined at exit so no tick runs during teardown,
+// then a game in progress is saved and its replay written out
+
+GameState lastTickState = MENU;
+unsigned long ticksRun = 0;
+
+void simulationLoop() {
+    nameTraceThread("simulation");
+    const Clock::duration tick = tickDuration();
+    const Fixed dt = tickFixed();
+    Clock::time_point simulated = Clock::now();
+
+    while (simRunning.load(std::memory_order_relaxed)) {
+        Clock::time_point now = Clock::now();
+        if (now - simulated > std::chrono::milliseconds(250)) {
+            simulated = now - tick;
+        }
+        while (simulated + tick <= now) {
+            Clock::time_point tickStart = Clock::now();
+            setGauge(G_TICK_ARENA_BYTES, (double)beginFrameArena().lastHighWater);
+            processInput();
+            reserveReplaySpace();
+            GameState before = game.gameState;
+            uint64_t mark = allocationMark();
+            updateGame(game, dt);
+            writeSpectatorTick(game);
+            expectNoAllocations("simulation tick", mark,
+                                ticksRun++ > 0 && before == lastTickState && game.gameState == before);
+            lastTickState = before;
+            simulated += tick;
+            countMetric(M_TICKS);
+            observeMetric(H_TICK_SECONDS, std::chrono::duration<double>(Clock::now() - tickStart).count());
+        }
+        publishSnapshot();
+
+        if (eventDrivenIdle && isStaticState(game.gameState)) {
+            std::unique_lock<std::mutex> lock(simWakeLock);
+            while (inputQueue.empty() && simRunning.load()) {
+                simWake.wait(lock);
+            }
+            simulated = Clock::now() - tick;
+            continue;
+        }
+        std::this_thread::sleep_until(simulated + tick);
+    }
+}
+
+void wakeSimulation() {
+    std::lock_guard<std::mutex> lock(simWakeLock);
+    simWake.notify_one();
+}
+
+void startSimulation() {
+    publishSnapshot();
+    simRunning = true;
+    simThread = std::thread(simulationLoop);
+}
+
+void stopSimulation() {
+    simRunning = false;
+    wakeSimulation();
+    if (simThread.joinable()) {
+        simThread.join();
+        saveOrClearOnExit();
+        finishReplay(game);
+    }
+}
+
+// ---------------------- Frame Pacing ----------------------
+// Keeps redraws on a 60 Hz grid of display deadlines
+// Measures display() work and glutSwapBuffers() separately each frame
+// Predicts next frame's cost as a smoothed average plus its jitter
+// timer() starts a frame just early enough to finish before its deadline
+// Deadlines that can no longer be met are skipped and counted as dropped
+// Frames whose swap finishes well past their deadline are counted as late
+// Only rendering is skipped; the simulation thread keeps its own clock
+// A vsync-blocking swap is waiting, not work, so it is not predicted
+
+struct FramePacer {
+    Clock::duration interval;
+    Clock::time_point deadline;       // next display deadline to aim for
+    Clock::time_point frameDeadline;  // deadline of the frame being drawn
+    bool framePending;
+    double predictedMs, jitterMs;
+    double renderMs, swapMs;
+    unsigned long rendered, dropped, late;
+    Clock::time_point lastLog;
+    unsigned long loggedRendered, loggedDropped, loggedLate;
+} pacer;
+
+bool showStats = false;
+
+void initFramePacer(int refreshHz) {
+    pacer = FramePacer();
+    pacer.interval = std::chrono::microseconds(1000000 / refreshHz);
+    pacer.deadline = Clock::now() + pacer.interval;
+    pacer.lastLog = Clock::now();
+    pacer.predictedMs = 2.0;
+    pacer.jitterMs = 1.0;
+}
+
+double millisBetween(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+Clock::duration predictedFrameCost() {
+    double ms = pacer.predictedMs + 2.0 * pacer.jitterMs;
+    return std::chrono::microseconds((long long)(ms * 1000.0));
+}
+
+void recordFrame(Clock::time_point start, Clock::time_point swapStart, Clock::time_point end) {
+    pacer.renderMs = millisBetween(start, swapStart);
+    pacer.swapMs = millisBetween(swapStart, end);
+    countMetric(M_FRAMES);
+    observeMetric(H_FRAME_SECONDS, pacer.renderMs / 1000.0);
+
+    double error = pacer.renderMs - pacer.predictedMs;
+    pacer.predictedMs += 0.125 * error;
+    pacer.jitterMs += 0.25 * (std::fabs(error) - pacer.jitterMs);
+
+    if (!pacer.framePending) return; // redraw from window exposure
+    pacer.framePending = false;
+    pacer.rendered++;
+    if (end > pacer.frameDeadline + pacer.interval / 2) {
+        pacer.late++;
+    }
+}
+
+// ---------------------- Input-to-Photon Latency ----------------------
+// Key press stamp travels keyboard() -> input queue -> tick -> snapshot
+// Recorded right after the swap that first shows the applied turn
+// Only turns applied in the tick that read them; a turn waiting for a
+// junction measures the maze, not the loop
+// Half-millisecond buckets up to 100 ms, last bucket catches the rest
+// Owned by the GLUT thread, so no locking
+
+const int LATENCY_BUCKETS = 200;
+const double LATENCY_BUCKET_MS = 0.5;
+
+struct LatencyHistogram {
+    unsigned long buckets[LATENCY_BUCKETS];
+    unsigned long samples;
+    unsigned int presentedSeq;
+} latency;
+
+void recordInputLatency(const FrameSnapshot &snap, Clock::time_point presented) {
+    if (snap.inputSeq == latency.presentedSeq) return;
+    latency.presentedSeq = snap.inputSeq;
+
+    int bucket = (int)(millisBetween(snap.inputStamp, presented) / LATENCY_BUCKET_MS);
+    latency.buckets[std::min(std::max(bucket, 0), LATENCY_BUCKETS - 1)]++;
+    latency.samples++;
+}
+
+double latencyPercentile(double fraction) {
+    if (latency.samples == 0) return 0;
+    unsigned long target = (unsigned long)std::ceil(fraction * latency.samples);
+    unsigned long seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += latency.buckets[i];
+        if (seen >= target) return (i + 1) * LATENCY_BUCKET_MS;
+    }
+    return LATENCY_BUCKETS * LATENCY_BUCKET_MS;
+}
+
+void drawLatencyHistogram(float x, float y) {
+    // 1 ms per bar up to 40 ms, height relative to the tallest bar
+    const int BARS = 40;
+    const int PER_BAR = (int)(1.0 / LATENCY_BUCKET_MS);
+    unsigned long counts[BARS] = {0};
+    unsigned long tallest = 1;
+    for (int bar = 0; bar < BARS; bar++) {
+        for (int k = 0; k < PER_BAR; k++) {
+            counts[bar] += latency.buckets[bar * PER_BAR + k];
+        }
+        tallest = std::max(tallest, counts[bar]);
+    }
+
+    glColor3f(0.6f, 1.0f, 0.6f);
+    glBegin(GL_QUADS);
+    for (int bar = 0; bar < BARS; bar++) {
+        float h = 1.2f * counts[bar] / tallest;
+        float left = x + bar * 0.2f;
+        glVertex2f(left, y);
+        glVertex2f(left + 0.15f, y);
+        glVertex2f(left + 0.15f, y + h);
+        glVertex2f(left, y + h);
+    }
+    glEnd();
+}
+
+// ---------------------- Stats Overlay ----------------------
+// Toggled with F3, drawn on top of whatever screen is showing
+// Frame cost, prediction and dropped/late frame totals
+// Input-to-photon p50/p99 with a 0-40 ms histogram
+// Frame arena high-water marks for the last tick and frame
+// Same numbers logged to stderr every five seconds
+
+void logFrameStats() {
+    Clock::time_point now = Clock::now();
+    if (now - pacer.lastLog < std::chrono::seconds(5)) return;
+
+    std::cerr << "[frames] rendered " << pacer.rendered - pacer.loggedRendered
+              << " dropped " << pacer.dropped - pacer.loggedDropped
+              << " late " << pacer.late - pacer.loggedLate
+              << " render " << pacer.renderMs << "ms"
+              << " swap " << pacer.swapMs << "ms"
+              << " predicted " << pacer.predictedMs << "ms"
+              << " input p50 " << latencyPercentile(0.50) << "ms"
+              << " p99 " << latencyPercentile(0.99) << "ms" << std::endl;
+    pacer.loggedRendered = pacer.rendered;
+    pacer.loggedDropped = pacer.dropped;
+    pacer.loggedLate = pacer.late;
+    pacer.lastLog = now;
+}
+
+void drawStatsOverlay() {
+    char line[96];
+    glColor3f(0.6f, 1.0f, 0.6f);
+    std::snprintf(line, sizeof(line), "render %.2fms  swap %.2fms  predicted %.2fms",
+                  pacer.renderMs, pacer.swapMs, pacer.predictedMs);
+    drawTextSmall(0.5f, 18.8f, line);
+    std::snprintf(line, sizeof(line), "frames %lu  dropped %lu  late %lu",
+                  pacer.rendered, pacer.dropped, pacer.late);
+    drawTextSmall(0.5f, 18.2f, line);
+    std::snprintf(line, sizeof(line), "input->photon p50 %.1fms  p99 %.1fms  (%lu)",
+                  latencyPercentile(0.50), latencyPercentile(0.99), latency.samples);
+    drawTextSmall(0.5f, 17.6f, line);
+    const FrameArena &arena = currentFrameArena();
+    std::snprintf(line, sizeof(line), "arena high water: tick %.0f B  frame %lu B  peak %lu B  overflows %llu",
+                  metrics.gauges[G_TICK_ARENA_BYTES].load(), (unsigned long)arena.lastHighWater,
+                  (unsigned long)arena.peakHighWater, (unsigned long long)arena.overflows);
+    drawTextSmall(0.5f, 17.0f, line);
+    drawLatencyHistogram(0.5f, 15.6f);
+}
+
+// ---------------------- Idle Rendering & CPU Accounting ----------------------
+// Once a static screen is on display and every key press has been handled,
+// the render timer stops; GLUT still redraws on window exposure
+// keyboard() restarts the timer, so only input or exposure costs CPU
+// Each stretch of static screen is timed in process CPU and wall time
+// and logged as CPU milliseconds per idle minute, in either idle mode
+
+bool renderIdle = false;
+bool renderTimerRunning = false;
+unsigned int keysQueued = 0; // GLUT thread count of pushed key presses
+
+struct IdleSpan {
+    bool open;
+    double cpuStart;
+    Clock::time_point wallStart;
+    double totalCpu, totalWall;
+} idleSpan;
+
+double processCpuSeconds() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user);
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime; k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime; u.HighPart = user.dwHighDateTime;
+    return (k.QuadPart + u.QuadPart) * 1e-7;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+#endif
+}
+
+double idleCpuMsPerMinute() {
+    return idleSpan.totalWall > 0 ? idleSpan.totalCpu * 1000.0 * 60.0 / idleSpan.totalWall : 0;
+}
+
+void beginIdleSpan() {
+    if (idleSpan.open) return;
+    idleSpan.open = true;
+    idleSpan.cpuStart = processCpuSeconds();
+    idleSpan.wallStart = Clock::now();
+}
+
+void endIdleSpan() {
+    if (!idleSpan.open) return;
+    idleSpan.open = false;
+    double cpu = processCpuSeconds() - idleSpan.cpuStart;
+    double wall = std::chrono::duration<double>(Clock::now() - idleSpan.wallStart).count();
+    idleSpan.totalCpu += cpu;
+    idleSpan.totalWall += wall;
+    if (wall >= 1.0) {
+        std::cerr << "[idle] " << wall << "s on static screen, "
+                  << cpu * 1000.0 * 60.0 / wall << " ms CPU/min ("
+                  << (eventDrivenIdle ? "event-driven" : "busy") << "), overall "
+                  << idleCpuMsPerMinute() << " ms CPU/min" << std::endl;
+    }
+}
+
+void updateIdleState(const FrameSnapshot &snap) {
+    bool settled = isStaticState(snap.gameState) && snap.inputsHandled == keysQueued;
+    if (settled) {
+        beginIdleSpan();
+    } else {
+        endIdleSpan();
+    }
+    renderIdle = settled && eventDrivenIdle;
+}
+
+// ---------------------- Display/Rendering Function ----------------------
+// Main rendering function called every frame
+// Sets dark blue background color
+// Renders different screens based on game state:
+// MENU: Title, navigation options (Start, Resume, Help, High Score, Exit)
+// HELP: Complete instructions, controls, ghost behaviors, power-up explanations
+// HIGHSCORE: Displays the top 10 leaderboard with time, date and seed
+// PLAYING/PAUSED: Game board, Pacman, ghosts, HUD (score, time, lives)
+//   Shows active power-up name, pause overlay
+// GAMEOVER: Final score, time, menu option
+// WIN: Congratulations, final score, new high score notification
+// Double buffering used for smooth rendering
+// Reads only the latest published snapshot, never the live game state
+// Times its own work and the buffer swap for the frame pacer
+// Records input-to-photon latency once the swap has been issued
+// Lets the render timer stop once a static screen is fully drawn
+// Formats into stack buffers, so a frame never touches the heap
+
+// One "P1 120 x3" entry per player across the screen, in their colors;
+// the final score above is the players' total
+void drawPlayerScores(const FrameSnapshot &snap, float y) {
+    for (int p = 0; p < snap.playerCount; p++) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "P%d %d x%d", p + 1, snap.pacmen[p].score, snap.pacmen[p].lives);
+        glColor3fv(PLAYER_COLORS[p]);
+        drawTextSmall(0.5f + p * 5.0f, y, text);
+    }
+    glColor3f(0.0f, 1.0f, 1.0f);
+}
+
+void drawFinalScore(const FrameSnapshot &snap, int score, int gameTime) {
+    char text[48];
+    std::snprintf(text, sizeof(text), "Final Score: %d", score);
+    drawText(6.0f, 11.0f, text);
+    if (snap.playerCount > 1) drawPlayerScores(snap, 12.0f);
+    std::snprintf(text, sizeof(text), "Time: %d seconds", gameTime);
+    drawText(6.0f, 10.0f, text);
+}
+
+GameState lastFrameState = MENU;
+unsigned long framesDrawn = 0;
+
+void display() {
+    TRACE_SCOPE("display");
+    setGauge(G_FRAME_ARENA_BYTES, (double)beginFrameArena().lastHighWater);
+    uint64_t allocations = allocationMark();
+    Clock::time_point frameStart = Clock::now();
+    const FrameSnapshot &snap = snapshots.acquire();
+    const GameState gameState = snap.gameState;
+    const int score = snap.score;
+    const int lives = snap.lives;
+    const int gameTime = snap.gameTime;
+    const int activePowerUp = snap.activePowerUp;
+
+    glClearColor(0.05f, 0.05f, 0.15f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glColor3f(0.0f, 1.0f, 1.0f);
+
+    if (gameState == MENU) {
+        drawText(6.5f, 14.0f, "PACMAN GAME");
+        drawText(6.0f, 11.0f, "Press SPACE to Start");
+        drawTextSmall(5.5f, 10.4f, "or 2, 3, 4 for that many players");
+        drawText(6.5f, 9.5f,  "Press R to Resume");
+        drawText(6.5f, 8.5f,  "Press H for Help");
+        drawText(5.5f, 7.5f,  "Press S for High Score");
+        drawText(6.5f, 6.5f,  "Press ESC to Exit");
+    }
+    else if (gameState == HELP) {
+        drawText(7.0f, 16.0f, "HOW TO PLAY");
+        drawTextSmall(3.0f, 14.0f, "CONTROLS:");
+        drawTextSmall(3.0f, 13.0f, "W/A/S/D - Move Up/Left/Down/Right");
+        drawTextSmall(3.0f, 12.5f, "Players 2-4: I/J/K/L, T/F/G/H, 8/4/5/6");
+        drawTextSmall(3.0f, 12.0f, "P - Pause, V - Save, M - Menu, ESC - Exit");
+
+        drawTextSmall(3.0f, 10.5f, "GHOSTS:");
+        drawTextSmall(3.0f, 9.5f, "Blinky (Red) - Chases you directly");
+        drawTextSmall(3.0f, 8.8f, "Pinky (Pink) - Ambushes ahead");
+        drawTextSmall(3.0f, 8.1f, "Inky (Cyan) - Tries to corner you");
+        drawTextSmall(3.0f, 7.4f, "Clyde (Orange) - Random movement");
+
+        drawTextSmall(3.0f, 6.2f, "POWER-UPS (Magenta circles):");
+        drawTextSmall(3.0f, 5.5f, "Invincible - Eat ghosts!");
+        drawTextSmall(3.0f, 4.8f, "Freeze - Stops ghosts");
+        drawTextSmall(3.0f, 4.1f, "Speed - Move faster");
+
+        drawText(6.5f, 2.0f, "Press M for Menu");
+    }
+    else if (gameState == HIGHSCORE) {
+        drawText(6.5f, 17.0f, "HIGH SCORES");
+        if (snap.leaderboard.count == 0) {
+            drawText(6.0f, 12.0f, "No games yet");
+        }
+        for (int i = 0; i < snap.leaderboard.count; i++) {
+            const LeaderboardEntry &e = snap.leaderboard.entries[i];
+            time_t when = (time_t)e.date;
+            char date[16] = "----------";
+            if (e.date > 0) {
+                strftime(date, sizeof(date), "%Y-%m-%d", localtime(&when));
+            }
+            char line[96];
+            std::snprintf(line, sizeof(line), "%2d.  %6d   %4ds   %s   seed %u",
+                          i + 1, e.score, e.seconds, date, e.seed);
+            drawTextSmall(4.0f, 15.5f - i * 0.8f, line);
+        }
+        drawText(6.5f, 5.0f, "Press M for Menu");
+    }
+    else if (gameState == PLAYING || gameState == PAUSED) {
+        drawBoard(snap.board);
+        for (int p = 0; p < snap.playerCount; p++) {
+            if (snap.pacmen[p].lives > 0) drawPacman(snap.pacmen[p], p, activePowerUp);
+        }
+        for (int i = 0; i < snap.ghostCount; i++) {
+            drawGhost(snap.ghosts[i], activePowerUp);
+        }
+
+        char text[32];
+        if (snap.playerCount > 1) {
+            drawPlayerScores(snap, 19.5f);
+        } else {
+            std::snprintf(text, sizeof(text), "Score: %d", score);
+            drawTextSmall(0.5f, 19.5f, text);
+            std::snprintf(text, sizeof(text), "Lives: %d", lives);
+            drawTextSmall(14.0f, 19.5f, text);
+        }
+        std::snprintf(text, sizeof(text), "Time: %ds", gameTime);
+        drawTextSmall(7.0f, snap.playerCount > 1 ? 0.5f : 19.5f, text);
+
+        if (activePowerUp >= 0 && activePowerUp < 3) {
+            static const char *const POWER_TEXT[3] = { "POWER: INVINCIBLE!", "POWER: FREEZE!", "POWER: SPEED!" };
+            drawTextSmall(6.0f, 0.5f, POWER_TEXT[activePowerUp]);
+        }
+
+        if (gameState == PAUSED) {
+            drawText(5.5f, 10.0f, "PAUSED - Press P to Resume");
+        }
+    }
+    else if (gameState == GAMEOVER) {
+        drawText(7.0f, 13.0f, "GAME OVER!");
+        drawFinalScore(snap, score, gameTime);
+        drawText(6.5f, 8.0f, "Press M for Menu");
+    }
+    else if (gameState == WIN) {
+        drawText(7.5f, 13.0f, "YOU WIN!");
+        drawFinalScore(snap, score, gameTime);
+        if (snap.lastRank == 1) {
+            drawText(5.5f, 9.0f, "NEW HIGH SCORE!");
+        }
+        drawText(6.5f, 7.0f, "Press M for Menu");
+    }
+
+    if (showStats) {
+        drawStatsOverlay();
+    }
+
+    Clock::time_point swapStart = Clock::now();
+    {
+        TRACE_SCOPE("glutSwapBuffers");
+        glutSwapBuffers();
+    }
+    Clock::time_point swapEnd = Clock::now();
+    recordFrame(frameStart, swapStart, swapEnd);
+    recordInputLatency(snap, swapEnd);
+    updateIdleState(snap);
+    expectNoAllocations("display()", allocations, framesDrawn++ > 0 && gameState == lastFrameState);
+    lastFrameState = gameState;
+    logFrameStats();
+}
+
+// ---------------------- Timer Callback Function ----------------------
+// Drives redraws on the GLUT thread; game logic runs on the simulation thread
+// Skips any deadline the predicted frame cost can no longer meet
+// Waits if it woke early, so frames are not drawn sooner than needed
+// Reschedules itself for the next frame until rendering goes idle
+
+void timer(int);
+
+void scheduleFrame(Clock::time_point now) {
+    Clock::time_point start = pacer.deadline - predictedFrameCost();
+    long long ms = std::chrono::duration_cast<std::chrono::milliseconds>(start - now).count();
+    glutTimerFunc(ms > 0 ? (unsigned)ms : 0, timer, 0);
+}
+
+void timer(int) {
+    TRACE_SCOPE("timer");
+    if (renderIdle) {
+        renderTimerRunning = false;
+        return;
+    }
+
+    Clock::time_point now = Clock::now();
+    Clock::duration cost = predictedFrameCost();
+
+    while (now + cost > pacer.deadline) {
+        pacer.dropped++;
+        countMetric(M_DROPPED_FRAMES);
+        pacer.deadline += pacer.interval;
+    }
+
+    if (pacer.deadline - cost - now > std::chrono::milliseconds(1)) {
+        scheduleFrame(now);
+        return;
+    }
+
+    pacer.frameDeadline = pacer.deadline;
+    pacer.framePending = true;
+    pacer.deadline += pacer.interval;
+    glutPostRedisplay();
+    scheduleFrame(now);
+}
+
+void startRenderTimer() {
+    renderIdle = false;
+    if (renderTimerRunning) return;
+    renderTimerRunning = true;
+    pacer.deadline = Clock::now() + pacer.interval;
+    glutTimerFunc(0, timer, 0);
+}
+
+// ---------------------- GLUT Input Callbacks ----------------------
+// keyboard() only stamps and queues the press for the simulation thread
+// ESC exits straight away
+// Any key wakes an idle simulation and restarts an idle render timer
+// specialKey() handles F3, which only affects rendering
+
+void keyboard(unsigned char key, int x, int y) {
+    if (key == 27) exit(0); // ESC
+
+    InputEvent event;
+    event.key = key;
+    event.stamp = Clock::now();
+    if (inputQueue.push(event)) {
+        keysQueued++;
+    }
+    endIdleSpan();
+    wakeSimulation();
+    startRenderTimer();
+}
+
+void specialKey(int key, int, int) {
+    if (key == GLUT_KEY_F3) {
+        showStats = !showStats;
+        glutPostRedisplay();
+    }
+}
+
+// ---------------------- Metrics Export ----------------------
+// Prometheus text format, built from the merged shards on demand
+// --metrics-file PATH rewrites PATH every 10 seconds and at exit,
+// via a temp file and rename so scrapers never see half a file
+// --metrics-socket PATH serves one snapshot per connection on a local
+// Unix socket (not available on Windows), e.g. nc -U PATH
+// One background thread does both, never the game or render thread
+
+const int METRICS_EXPORT_SECONDS = 10;
+
+struct MetricsExporter {
+    std::string filePath;
+    std::string socketPath;
+    int listenFd;
+    std::atomic<bool> running{false};
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable stop;
+} metricsExport;
+
+std::string formatMetrics() {
+    std::ostringstream out;
+    for (int c = 0; c < COUNTER_COUNT; c++) {
+        out << "# HELP " << counterInfo[c].name << " " << counterInfo[c].help << "\n"
+            << "# TYPE " << counterInfo[c].name << " counter\n"
+            << counterInfo[c].name << " " << readCounter((CounterId)c) << "\n";
+    }
+    for (int g = 0; g < GAUGE_COUNT; g++) {
+        out << "# HELP " << gaugeInfo[g].name << " " << gaugeInfo[g].help << "\n"
+            << "# TYPE " << gaugeInfo[g].name << " gauge\n"
+            << gaugeInfo[g].name << " " << metrics.gauges[g].load() << "\n";
+    }
+
+    int shardCount = std::min(metrics.shardCount.load(), MAX_METRIC_SHARDS);
+    for (int h = 0; h < HISTOGRAM_COUNT; h++) {
+        uint64_t buckets[HISTOGRAM_BUCKETS + 1] = {0};
+        uint64_t sumNanos = 0;
+        for (int i = 0; i <= shardCount; i++) {
+            const MetricShard &shard = i < shardCount ? *metrics.shards[i] : metrics.overflow;
+            for (int b = 0; b <= HISTOGRAM_BUCKETS; b++) {
+                buckets[b] += shard.buckets[h][b].load(std::memory_order_relaxed);
+            }
+            sumNanos += shard.sumNanos[h].load(std::memory_order_relaxed);
+        }
+
+        const char *name = histogramInfo[h].name;
+        out << "# HELP " << name << " " << histogramInfo[h].help << "\n"
+            << "# TYPE " << name << " histogram\n";
+        uint64_t cumulative = 0;
+        for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+            cumulative += buckets[b];
+            out << name << "_bucket{le=\"" << histogramBounds[h][b] << "\"} " << cumulative << "\n";
+        }
+        cumulative += buckets[HISTOGRAM_BUCKETS];
+        out << name << "_bucket{le=\"+Inf\"} " << cumulative << "\n"
+            << name << "_sum " << sumNanos * 1e-9 << "\n"
+            << name << "_count " << cumulative << "\n";
+    }
+    return out.str();
+}
+
+void writeMetricsFile() {
+    std::string temp = metricsExport.filePath + ".tmp";
+    {
+        std::ofstream file(temp.c_str());
+        if (!file.is_open()) return;
+        file << formatMetrics();
+    }
+#ifdef _WIN32
+    std::remove(metricsExport.filePath.c_str());
+#endif
+    std::rename(temp.c_str(), metricsExport.filePath.c_str());
+}
+
+#ifndef _WIN32
+int openMetricsSocket(const std::string &path) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+        std::cerr << "Cannot listen on metrics socket " << path << std::endl;
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void serveMetricsClient() {
+    int client = accept(metricsExport.listenFd, 0, 0);
+    if (client < 0) return;
+    std::string text = formatMetrics();
+    size_t sent = 0;
+    while (sent < text.size()) {
+        ssize_t n = send(client, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) break;
+        sent += (size_t)n;
+    }
+    close(client);
+}
+#endif
+
+void metricsExportLoop() {
+    Clock::time_point nextWrite = Clock::now() + std::chrono::seconds(METRICS_EXPORT_SECONDS);
+    while (metricsExport.running.load()) {
+#ifndef _WIN32
+        if (metricsExport.listenFd >= 0) {
+            pollfd fds = { metricsExport.listenFd, POLLIN, 0 };
+            if (poll(&fds, 1, 250) > 0) {
+                serveMetricsClient();
+            }
+        } else
+#endif
+        {
+            std::unique_lock<std::mutex> lock(metricsExport.lock);
+            metricsExport.stop.wait_until(lock, nextWrite);
+        }
+        if (!metricsExport.filePath.empty() && Clock::now() >= nextWrite) {
+            writeMetricsFile();
+            nextWrite += std::chrono::seconds(METRICS_EXPORT_SECONDS);
+        }
+    }
+}
+
+void startMetricsExport() {
+    metricsExport.listenFd = -1;
+#ifndef _WIN32
+    if (!metricsExport.socketPath.empty()) {
+        metricsExport.listenFd = openMetricsSocket(metricsExport.socketPath);
+    }
+#endif
+    if (metricsExport.filePath.empty() && metricsExport.listenFd < 0) return;
+    metricsExport.running = true;
+    metricsExport.thread = std::thread(metricsExportLoop);
+}
+
+void stopMetricsExport() {
+    if (!metricsExport.running.load()) return;
+    {
+        std::lock_guard<std::mutex> lock(metricsExport.lock);
+        metricsExport.running = false;
+        metricsExport.stop.notify_all();
+    }
+    metricsExport.thread.join();
+    if (!metricsExport.filePath.empty()) {
+        writeMetricsFile();
+    }
+#ifndef _WIN32
+    if (metricsExport.listenFd >= 0) {
+        close(metricsExport.listenFd);
+        unlink(metricsExport.socketPath.c_str());
+    }
+#endif
+}
+
+// ---------------------- Job System Benchmark ----------------------
+// Run with --bench-jobs; prints results and exits without a window
+// Spawn cost: empty child jobs under one parent, created, run and waited
+// Scaling: the same parallelFor kernel with 1..N threads
+
+void emptyJob(Job *) {}
+
+volatile double benchSink = 0;
+
+void benchKernel(void *context, int begin, int end) {
+    double *out = (double *)context;
+    for (int i = begin; i < end; i++) {
+        out[i] = std::sqrt((double)i) * std::sin((double)i);
+    }
+}
+
+double benchSpawn(int batches, int batchSize) {
+    Clock::time_point start = Clock::now();
+    for (int b = 0; b < batches; b++) {
+        Job *root = createJob(emptyJob, 0);
+        for (int i = 0; i < batchSize; i++) {
+            runJob(createJob(emptyJob, 0, root));
+        }
+        runJob(root);
+        waitForJob(root);
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    return ns / ((double)batches * (batchSize + 1));
+}
+
+void runJobBenchmark() {
+    const int maxThreads = std::min((int)std::max(1u, std::thread::hardware_concurrency()), MAX_JOB_THREADS - 1);
+    const int count = 1 << 22;
+    std::vector<double> data(count);
+
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    double singleMs = 0;
+    for (size_t t = 0; t < threadCounts.size(); t++) {
+        int threads = threadCounts[t];
+        startJobSystem(threads - 1);
+        double spawnNs = benchSpawn(2000, 255);
+
+        parallelFor(count, 4096, benchKernel, &data[0]); // warm up
+        Clock::time_point start = Clock::now();
+        for (int rep = 0; rep < 10; rep++) {
+            parallelFor(count, 4096, benchKernel, &data[0]);
+        }
+        double ms = millisBetween(start, Clock::now()) / 10.0;
+        benchSink = benchSink + data[count / 2];
+
+        if (threads == 1) singleMs = ms;
+        std::printf("threads %2d  spawn %6.1f ns/job  parallelFor %7.2f ms  speedup %.2fx\n",
+                    threads, spawnNs, ms, singleMs / ms);
+        stopJobSystem();
+    }
+}
+
+// ---------------------- Simulation Benchmark ----------------------
+// Run with --bench-sim (after --sim-hz to pick the rate); no window
+// Plays the standard map headless with a bot turning every half second
+// Restarts the game on win or game over so every tick is a PLAYING tick
+// Times batches of ticks to keep clock reads out of the measurement
+// Logs events only if --event-log was given (handy for reader tests)
+// Records every game with --record DIR given before it (analyzer input)
+// Budget for high-rate play is 10 microseconds per tick
+// Counts heap allocations in ticks that keep playing and fails on any
+
+int runSimBenchmark() {
+    const int BATCH = 1000;
+    const int BATCHES = 2000;
+    const Fixed dt = tickFixed();
+    const int turnEvery = std::max(1, settings.simHz / 2);
+    std::vector<double> batchNs;
+
+    persistScores = false;
+    startDiskWriter();
+    startEventLog();
+    game.live = true;
+    startNewGame(game);
+
+    unsigned long tick = 0;
+    uint64_t steadyAllocations = 0;
+    for (int b = 0; b < BATCHES; b++) {
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < BATCH; i++, tick++) {
+            beginFrameArena();
+            uint64_t mark = allocationMark();
+            if (tick % turnEvery == 0) {
+                const int *d = TURN_DIRS[rand() % 4];
+                queueTurn(game, 0, d[0], d[1], Clock::now());
+            }
+            updateGame(game, dt);
+            if (game.gameState != PLAYING) {
+                startNewGame(game);
+            } else if (tick > 0) {
+                steadyAllocations += allocationMark() - mark;
+            }
+        }
+        batchNs.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() / BATCH);
+    }
+
+    std::sort(batchNs.begin(), batchNs.end());
+    double total = 0;
+    for (size_t i = 0; i < batchNs.size(); i++) total += batchNs[i];
+    std::printf("sim %d Hz: %lu ticks  mean %.1f ns/tick  median %.1f  p99 %.1f  (budget 10000)\n",
+                settings.simHz, tick, total / batchNs.size(), batchNs[batchNs.size() / 2],
+                batchNs[batchNs.size() * 99 / 100]);
+#ifdef COUNT_ALLOCATIONS
+    std::printf("heap allocations in ticks spent playing: %llu\n", (unsigned long long)steadyAllocations);
+#endif
+    const FrameArena &arena = beginFrameArena();
+    std::printf("frame arena: peak %lu bytes in one tick, %llu overflows\n",
+                (unsigned long)arena.peakHighWater, (unsigned long long)arena.overflows);
+    finishReplay(game);
+    stopEventLog();
+    stopDiskWriter();
+    return steadyAllocations ? 2 : 0;
+}
+
+// ---------------------- Entity Benchmark ----------------------
+// Run with --bench-entities [N]; no window
+// Four bot Pacmen play against 4, 64, 1024... and finally N ghosts
+// (20000 by default); prints the tick cost and the cost per ghost
+// Collision distance is zero for the run so no ghost catches anyone:
+// every tick plays on, and the collision system still sweeps every ghost row
+// Ghost AI runs on the job system; fails on any allocation in a tick
+
+int runEntityBenchmark(int maxGhosts) {
+    const int TICKS = 1000;
+    const Fixed dt = tickFixed();
+    persistScores = false;
+    const float collisionDistance = settings.collisionDistance;
+    settings.collisionDistance = 0;
+    startJobSystem(defaultWorkerCount());
+
+    std::vector<int> counts;
+    for (int n = MAX_GHOSTS; n < maxGhosts; n *= 16) counts.push_back(n);
+    counts.push_back(std::max(maxGhosts, 1));
+
+    World w; // not live: nothing logged or recorded
+    w.playerCount = MAX_PLAYERS;
+    uint64_t steadyAllocations = 0;
+    for (size_t c = 0; c < counts.size(); c++) {
+        startNewGame(w, 1);
+        w.ghosts.resize(counts[c]);
+        initGhosts(w);
+        int ticks = 0;
+        Clock::time_point start = Clock::now();
+        for (; ticks < TICKS && w.gameState == PLAYING; ticks++) {
+            beginFrameArena();
+            uint64_t mark = allocationMark();
+            if (ticks % 30 == 0) {
+                const int *d = TURN_DIRS[rand() % 4];
+                queueTurn(w, (ticks / 30) % MAX_PLAYERS, d[0], d[1], Clock::now());
+            }
+            updateGame(w, dt);
+            if (ticks > 0) steadyAllocations += allocationMark() - mark;
+        }
+        double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / std::max(ticks, 1);
+        std::printf("ghosts %6d: %5d ticks  %10.1f ns/tick  %6.2f ns/ghost\n",
+                    counts[c], ticks, ns, ns / counts[c]);
+    }
+    std::printf("threads %d, heap allocations in ticks: %llu\n",
+                jobs.threadCount.load(), (unsigned long long)steadyAllocations);
+    stopJobSystem();
+    settings.collisionDistance = collisionDistance;
+    return steadyAllocations ? 2 : 0;
+}
+
+// ---------------------- Event Log Reader ----------------------
+// Run with --read-events FILE...; prints totals and scan speed, no window
+// Reads 8 MB chunks and decodes varints in one tight loop without bounds
+// checks; a record cut by the chunk end is carried over to the next chunk
+
+struct EventTotals {
+    unsigned long long records[EVENT_TYPE_COUNT];
+    unsigned long long ticks;
+    unsigned long long bytes;
+    unsigned long long finalScores;
+};
+
+// Unchecked decode for the bulk of a chunk; caller guarantees
+// FAST_SCAN_MARGIN readable bytes. One-byte values take a single branch
+const size_t FAST_SCAN_MARGIN = 16;
+
+inline uint32_t getVarintFast(const unsigned char *&p) {
+    uint32_t value = *p++;
+    if (value < 0x80) return value;
+    value &= 0x7f;
+    for (int shift = 7; shift < 35; shift += 7) {
+        unsigned char byte = *p++;
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    return value;
+}
+
+inline bool getVarint(const unsigned char *&p, const unsigned char *end, uint32_t &value) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        unsigned char byte = *p++;
+        result |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool scanEventFile(const char *path, EventTotals &totals) {
+    FILE *file = std::fopen(path, "rb");
+    if (!file) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return false;
+    }
+    char magic[sizeof(EVENT_LOG_MAGIC)];
+    if (std::fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        std::memcmp(magic, EVENT_LOG_MAGIC, sizeof(magic)) != 0) {
+        std::cerr << path << " is not an event log" << std::endl;
+        std::fclose(file);
+        return false;
+    }
+    totals.bytes += sizeof(magic);
+
+    const size_t CHUNK = 8 << 20;
+    std::vector<unsigned char> buffer(CHUNK + FAST_SCAN_MARGIN);
+    size_t carried = 0;
+    bool eof = false;
+    while (!eof) {
+        size_t got = std::fread(&buffer[carried], 1, CHUNK, file);
+        eof = got < CHUNK;
+        totals.bytes += got;
+
+        const unsigned char *p = &buffer[0];
+        const unsigned char *end = p + carried + got;
+        const unsigned char *fastEnd = end - std::min((size_t)(end - p), FAST_SCAN_MARGIN);
+        unsigned long long counts[8] = {0};
+        unsigned long long ticks = 0, finalScores = 0;
+
+        // Bulk of the chunk: a whole record plus load slack always fits
+        while (p < fastEnd) {
+            uint32_t head = getVarintFast(p);
+            uint32_t payload = getVarintFast(p);
+            unsigned type = head & 7;
+            counts[type]++;
+            ticks += head >> 3;
+            finalScores += (type == EV_WIN || type == EV_LOSS) ? payload : 0;
+        }
+        // Tail: checked decode; an incomplete record waits for more data
+        while (eof && p < end) {
+            const unsigned char *record = p;
+            uint32_t head, payload;
+            if (!getVarint(p, end, head) || !getVarint(p, end, payload)) {
+                p = record;
+                break;
+            }
+            unsigned type = head & 7;
+            counts[type]++;
+            ticks += head >> 3;
+            finalScores += (type == EV_WIN || type == EV_LOSS) ? payload : 0;
+        }
+
+        if (counts[7]) {
+            std::cerr << path << ": bad record type 7" << std::endl;
+            std::fclose(file);
+            return false;
+        }
+        for (int t = 0; t < EVENT_TYPE_COUNT; t++) totals.records[t] += counts[t];
+        totals.ticks += ticks;
+        totals.finalScores += finalScores;
+        carried = (size_t)(end - p);
+        std::memmove(&buffer[0], p, carried);
+    }
+    std::fclose(file);
+    if (carried) {
+        std::cerr << path << ": " << carried << " trailing bytes of a cut record" << std::endl;
+    }
+    return true;
+}
+
+int runEventReader(int argc, char **argv, int first) {
+    EventTotals totals;
+    std::memset(&totals, 0, sizeof(totals));
+    Clock::time_point start = Clock::now();
+    for (int i = first; i < argc; i++) {
+        if (!scanEventFile(argv[i], totals)) return 1;
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (int t = 0; t < EVENT_TYPE_COUNT; t++) {
+        std::printf("%-12s %llu\n", eventTypeNames[t], totals.records[t]);
+    }
+    unsigned long long games = totals.records[EV_WIN] + totals.records[EV_LOSS];
+    std::printf("finished games %llu, mean final score %.1f\n", games,
+                games ? (double)totals.finalScores / games : 0.0);
+    std::printf("scanned %.1f MB in %.3f s (%.2f GB/s)\n", totals.bytes / 1e6, seconds,
+                seconds > 0 ? totals.bytes / seconds / 1e9 : 0.0);
+    return 0;
+}
+
+// ---------------------- Replay Analyzer ----------------------
+// Run with --analyze DIR [--analysis-out PREFIX]; no window
+// Loads every .rpl file in DIR, then replays them headless in parallel,
+// one World per replay, spread over the job system
+// Each job thread adds into its own partial stats; they are merged once
+// at the end so replays never contend on shared counters
+// Heatmaps per cell: Pacman occupancy, deaths and ghosts eaten
+// Per ghost: times it caught Pacman and times it was eaten
+// Time to clear: play time of every won game, in 5 second buckets
+// Writes PREFIX-*.ppm heatmap images and PREFIX-*.csv tables
+// Replays must share one set of settings; others are skipped, and a
+// replay that does not end where it was recorded counts as out of sync
+
+const int HEATMAP_CELL_PIXELS = 20;
+const int CLEAR_BUCKET_SECONDS = 5;
+
+struct alignas(64) ReplayStats {
+    uint64_t occupancy[ROWS][COLS]; // ticks Pacman spent in each cell
+    uint32_t deaths[ROWS][COLS];
+    uint32_t ghostsEaten[ROWS][COLS];
+    uint32_t catches[MAX_GHOSTS];
+    uint32_t eaten[MAX_GHOSTS];
+    std::vector<float> clearSeconds;
+    uint64_t ticks;
+    uint32_t games, wins, losses, unfinished, outOfSync;
+};
+
+struct ReplayBatch {
+    const std::vector<std::string> *replays;
+    std::vector<ReplayStats> *partials; // one per job thread
+};
+
+void onReplayEvent(void *context, EventType type, int cell, int actor) {
+    ReplayStats &stats = *(ReplayStats *)context;
+    if (type == EV_LIFE_LOST) {
+        stats.deaths[cell / COLS][cell % COLS]++;
+        if (actor >= 0 && actor < MAX_GHOSTS) stats.catches[actor]++;
+    } else if (type == EV_GHOST_EATEN) {
+        stats.ghostsEaten[cell / COLS][cell % COLS]++;
+        if (actor >= 0 && actor < MAX_GHOSTS) stats.eaten[actor]++;
+    }
+}
+
+void replayGame(const std::string &data, ReplayStats &stats) {
+    ReplayHeader header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    const unsigned char *p = (const unsigned char *)data.data() + sizeof(header);
+    const unsigned char *end = (const unsigned char *)data.data() + data.size();
+
+    World w;
+    w.onEvent = onReplayEvent;
+    w.eventContext = &stats;
+    applyGameImage(w, header.start);
+    w.gameState = PLAYING;
+
+    uint32_t left = header.inputCount;
+    uint32_t record = 0;
+    long nextFrame = -1;
+    if (left > 0 && getVarint(p, end, record)) nextFrame = w.frameCount + (record >> 4);
+
+    while (w.gameState == PLAYING && w.frameCount < (int)header.endFrame) {
+        while (nextFrame == w.frameCount) {
+            const int *d = TURN_DIRS[record & 3];
+            queueTurn(w, (record >> 2) & 3, d[0], d[1], Clock::time_point());
+            nextFrame = (--left > 0 && getVarint(p, end, record)) ? nextFrame + (record >> 4) : -1;
+        }
+        updateGame(w, header.dt);
+        each<Position>(w.pacmen, 0, w.playerCount, [&](size_t, const Position &pos) {
+            int cell = boardIndex(pos.x, pos.y);
+            if (cell >= 0) stats.occupancy[cell / COLS][cell % COLS]++;
+        });
+        stats.ticks++;
+    }
+
+    stats.games++;
+    if (w.gameState == WIN) {
+        stats.wins++;
+        stats.clearSeconds.push_back((float)((double)w.playTime / FIXED_ONE));
+    } else if (w.gameState == GAMEOVER) {
+        stats.losses++;
+    } else {
+        stats.unfinished++;
+    }
+    bool ended = header.endState == WIN || header.endState == GAMEOVER;
+    if (totalScore(w) != header.endScore || livesLeft(w) != header.endLives ||
+        (ended && w.gameState != header.endState)) {
+        stats.outOfSync++;
+    }
+}
+
+void replayRange(void *context, int begin, int end) {
+    ReplayBatch *batch = (ReplayBatch *)context;
+    ReplayStats &stats = (*batch->partials)[currentJobThread()];
+    for (int i = begin; i < end; i++) {
+        replayGame((*batch->replays)[i], stats);
+    }
+}
+
+void mergeReplayStats(ReplayStats &into, const ReplayStats &from) {
+    for (int i = 0; i < ROWS; i++) {
+        for (int j = 0; j < COLS; j++) {
+            into.occupancy[i][j] += from.occupancy[i][j];
+            into.deaths[i][j] += from.deaths[i][j];
+            into.ghostsEaten[i][j] += from.ghostsEaten[i][j];
+        }
+    }
+    for (int g = 0; g < MAX_GHOSTS; g++) {
+        into.catches[g] += from.catches[g];
+        into.eaten[g] += from.eaten[g];
+    }
+    into.clearSeconds.insert(into.clearSeconds.end(), from.clearSeconds.begin(), from.clearSeconds.end());
+    into.ticks += from.ticks;
+    into.games += from.games; into.wins += from.wins; into.losses += from.losses;
+    into.unfinished += from.unfinished; into.outOfSync += from.outOfSync;
+}
+
+std::vector<std::string> listReplayFiles(const std::string &dir) {
+    std::vector<std::string> paths;
+#ifdef _WIN32
+    WIN32_FIND_DATAA found;
+    HANDLE search = FindFirstFileA((dir + "\\*.rpl").c_str(), &found);
+    if (search == INVALID_HANDLE_VALUE) return paths;
+    do {
+        paths.push_back(dir + "\\" + found.cFileName);
+    } while (FindNextFileA(search, &found));
+    FindClose(search);
+#else
+    DIR *listing = opendir(dir.c_str());
+    if (!listing) return paths;
+    while (struct dirent *entry = readdir(listing)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".rpl") == 0) {
+            paths.push_back(dir + "/" + name);
+        }
+    }
+    closedir(listing);
+#endif
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+// Reads and checks one replay; empty result when it cannot be used
+std::string loadReplay(const std::string &path) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    ReplayHeader header;
+    const char *problem = 0;
+    if (data.size() < sizeof(header) || std::memcmp(data.data(), REPLAY_MAGIC, sizeof(REPLAY_MAGIC)) != 0) {
+        problem = "not a replay";
+    } else {
+        std::memcpy(&header, data.data(), sizeof(header));
+        size_t skip = offsetof(ReplayHeader, checksum) + sizeof(header.checksum);
+        if (header.settingsSize != sizeof(Settings) || header.imageSize != sizeof(GameImage)) {
+            problem = "recorded by a different version";
+        } else if (header.checksum != fnv1a(data.data() + skip, data.size() - skip)) {
+            problem = "checksum mismatch";
+        } else if (!gameImageIsSane(header.start) || header.dt <= 0) {
+            problem = "state out of range";
+        }
+    }
+    if (problem) {
+        std::cerr << "Skipping " << path << ": " << problem << std::endl;
+        data.clear();
+    }
+    return data;
+}
+
+void writeHeatmap(const std::string &path, const World &maze, const uint64_t *cells) {
+    uint64_t peak = 1;
+    for (int c = 0; c < ROWS * COLS; c++) peak = std::max(peak, cells[c]);
+
+    const int width = COLS * HEATMAP_CELL_PIXELS, height = ROWS * HEATMAP_CELL_PIXELS;
+    std::vector<unsigned char> pixels(width * height * 3);
+    for (int y = 0; y < height; y++) {
+        int row = ROWS - 1 - y / HEATMAP_CELL_PIXELS; // row 0 is the bottom of the maze
+        for (int x = 0; x < width; x++) {
+            int col = x / HEATMAP_CELL_PIXELS;
+            unsigned char *px = &pixels[(y * width + x) * 3];
+            if (maze.board[row][col] == 2) {
+                px[0] = 50; px[1] = 0; px[2] = 150; // walls in the maze's own color
+                continue;
+            }
+            // Log scale, black -> red -> yellow -> white
+            float t = (float)(std::log1p((double)cells[row * COLS + col]) / std::log1p((double)peak));
+            px[0] = (unsigned char)(255 * std::min(1.0f, 3 * t));
+            px[1] = (unsigned char)(255 * std::max(0.0f, std::min(1.0f, 3 * t - 1)));
+            px[2] = (unsigned char)(255 * std::max(0.0f, std::min(1.0f, 3 * t - 2)));
+        }
+    }
+    FILE *out = std::fopen(path.c_str(), "wb");
+    if (!out) {
+        std::cerr << "Cannot write " << path << std::endl;
+        return;
+    }
+    std::fprintf(out, "P6\n%d %d\n255\n", width, height);
+    std::fwrite(&pixels[0], 1, pixels.size(), out);
+    std::fclose(out);
+}
+
+void writeAnalysis(const std::string &prefix, const ReplayStats &total) {
+    World maze; // layout for the outputs
+    initBoard(maze);
+
+    uint64_t deaths[ROWS * COLS], eaten[ROWS * COLS];
+    for (int c = 0; c < ROWS * COLS; c++) {
+        deaths[c] = total.deaths[c / COLS][c % COLS];
+        eaten[c] = total.ghostsEaten[c / COLS][c % COLS];
+    }
+    writeHeatmap(prefix + "-occupancy.ppm", maze, &total.occupancy[0][0]);
+    writeHeatmap(prefix + "-deaths.ppm", maze, deaths);
+    writeHeatmap(prefix + "-ghosts-eaten.ppm", maze, eaten);
+
+    std::ofstream cells((prefix + "-cells.csv").c_str());
+    cells << "row,col,occupancy_ticks,deaths,ghosts_eaten\n";
+    for (int i = 0; i < ROWS; i++) {
+        for (int j = 0; j < COLS; j++) {
+            cells << i << "," << j << "," << total.occupancy[i][j] << ","
+                  << total.deaths[i][j] << "," << total.ghostsEaten[i][j] << "\n";
+        }
+    }
+
+    std::ofstream ghostsCsv((prefix + "-ghosts.csv").c_str());
+    ghostsCsv << "ghost,catches,times_eaten\n";
+    for (int g = 0; g < MAX_GHOSTS; g++) {
+        ghostsCsv << GHOST_ROSTER[g].name << "," << total.catches[g] << "," << total.eaten[g] << "\n";
+    }
+
+    std::vector<float> clear = total.clearSeconds;
+    std::sort(clear.begin(), clear.end());
+    std::ofstream clearCsv((prefix + "-clear-times.csv").c_str());
+    clearCsv << "seconds_from,seconds_to,games\n";
+    for (size_t i = 0; i < clear.size();) {
+        int bucket = (int)clear[i] / CLEAR_BUCKET_SECONDS;
+        size_t n = 0;
+        while (i < clear.size() && (int)clear[i] / CLEAR_BUCKET_SECONDS == bucket) { i++; n++; }
+        clearCsv << bucket * CLEAR_BUCKET_SECONDS << "," << (bucket + 1) * CLEAR_BUCKET_SECONDS << "," << n << "\n";
+    }
+
+    if (!clear.empty()) {
+        std::printf("time to clear: min %.1f s  median %.1f s  p90 %.1f s  max %.1f s\n",
+                    clear.front(), clear[clear.size() / 2], clear[clear.size() * 9 / 10], clear.back());
+    }
+    for (int g = 0; g < MAX_GHOSTS; g++) {
+        std::printf("%-7s caught Pacman %u times, eaten %u times\n",
+                    GHOST_ROSTER[g].name, total.catches[g], total.eaten[g]);
+    }
+}
+
+int runReplayAnalyzer(const std::string &dir, const std::string &prefix) {
+    Clock::time_point start = Clock::now();
+    std::vector<std::string> paths = listReplayFiles(dir);
+    std::vector<std::string> replays;
+    replays.reserve(paths.size());
+    Settings recorded;
+    int skipped = 0;
+    for (size_t i = 0; i < paths.size(); i++) {
+        std::string data = loadReplay(paths[i]);
+        if (data.empty()) {
+            skipped++;
+            continue;
+        }
+        const ReplayHeader *header = (const ReplayHeader *)data.data();
+        if (replays.empty()) {
+            std::memcpy(&recorded, &header->settings, sizeof(recorded));
+        } else if (std::memcmp(&recorded, &header->settings, sizeof(recorded)) != 0) {
+            skipped++; // the simulation runs on one global settings struct
+            continue;
+        }
+        replays.push_back(data);
+    }
+    if (replays.empty()) {
+        std::cerr << "No usable replays in " << dir << std::endl;
+        return 1;
+    }
+    settings = recorded;
+    double loadSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    persistScores = false;
+    startJobSystem(defaultWorkerCount());
+    std::vector<ReplayStats> partials(MAX_JOB_THREADS);
+    ReplayBatch batch = { &replays, &partials };
+    Clock::time_point simStart = Clock::now();
+    parallelFor((int)replays.size(), 1, replayRange, &batch);
+    double simSeconds = std::chrono::duration<double>(Clock::now() - simStart).count();
+    int threads = jobs.threadCount.load();
+    stopJobSystem();
+
+    ReplayStats total = ReplayStats();
+    for (size_t i = 0; i < partials.size(); i++) mergeReplayStats(total, partials[i]);
+
+    std::printf("%u replays (%d skipped): %u won, %u lost, %u unfinished, %u out of sync\n",
+                total.games, skipped, total.wins, total.losses, total.unfinished, total.outOfSync);
+    std::printf("loaded in %.3f s, replayed %llu ticks in %.3f s on %d threads (%.0f replays/s)\n",
+                loadSeconds, (unsigned long long)total.ticks, simSeconds, threads,
+                simSeconds > 0 ? total.games / simSeconds : 0.0);
+    writeAnalysis(prefix, total);
+    return total.outOfSync ? 2 : 0;
+}
+
+// ---------------------- UDP Sockets ----------------------
+// Thin layer over BSD sockets and Winsock for the multiplayer modes
+// Non-blocking datagram sockets; waitForPacket() sleeps in select()
+// Addresses are IPv4 "host:port"; a bare port means this machine
+
+#ifdef _WIN32
+typedef SOCKET NetSocket;
+const NetSocket NO_SOCKET = INVALID_SOCKET;
+#else
+typedef int NetSocket;
+const NetSocket NO_SOCKET = -1;
+#endif
+
+const int MAX_PACKET = 1400; // stays under a typical MTU
+
+bool startNetworking() {
+#ifdef _WIN32
+    WSADATA data;
+    return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+    return true;
+#endif
+}
+
+void closeSocket(NetSocket sock) {
+#ifdef _WIN32
+    closesocket(sock);
+#else
+    close(sock);
+#endif
+}
+
+bool resolveAddress(const std::string &text, sockaddr_in &addr) {
+    size_t colon = text.rfind(':');
+    std::string host = colon == std::string::npos ? "" : text.substr(0, colon);
+    std::string port = colon == std::string::npos ? text : text.substr(colon + 1);
+    if (host.empty()) host = "127.0.0.1";
+
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo *found = 0;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0 || !found) return false;
+    std::memcpy(&addr, found->ai_addr, sizeof(addr));
+    freeaddrinfo(found);
+    return true;
+}
+
+// Binds to the port on all interfaces; port 0 picks a free one
+NetSocket openUdpSocket(uint16_t port) {
+    NetSocket sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock == NO_SOCKET) return NO_SOCKET;
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(sock, (sockaddr *)&addr, sizeof(addr)) != 0) {
+        closeSocket(sock);
+        return NO_SOCKET;
+    }
+#ifdef _WIN32
+    u_long nonBlocking = 1;
+    ioctlsocket(sock, FIONBIO, &nonBlocking);
+#else
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+#endif
+    return sock;
+}
+
+uint16_t socketPort(NetSocket sock) {
+    sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    if (getsockname(sock, (sockaddr *)&addr, &len) != 0) return 0;
+    return ntohs(addr.sin_port);
+}
+
+bool sameAddress(const sockaddr_in &a, const sockaddr_in &b) {
+    return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+}
+
+void sendPacket(NetSocket sock, const sockaddr_in &to, const unsigned char *data, size_t size) {
+    sendto(sock, (const char *)data, (int)size, 0, (const sockaddr *)&to, sizeof(to));
+}
+
+// Next waiting datagram's size, 0 when there is none
+int receivePacket(NetSocket sock, unsigned char *buffer, sockaddr_in &from) {
+    socklen_t len = sizeof(from);
+    int n = (int)recvfrom(sock, (char *)buffer, MAX_PACKET, 0, (sockaddr *)&from, &len);
+    return n > 0 ? n : 0;
+}
+
+void waitForPacket(NetSocket sock, long micros) {
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(sock, &readable);
+    timeval timeout = { (long)(micros / 1000000), (long)(micros % 1000000) };
+    select((int)sock + 1, &readable, 0, 0, &timeout);
+}
+
+inline void putU32(unsigned char *out, uint32_t value) {
+    for (int i = 0; i < 4; i++) out[i] = (unsigned char)(value >> (8 * i));
+}
+
+inline uint32_t getU32(const unsigned char *in) {
+    return in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+// ---------------------- Bit Packing ----------------------
+// Values of any width up to 32 bits, least significant bit first
+// A writer past its buffer drops bits and flags overflow; a reader
+// past the end returns zeros and flags bad, so neither overruns
+
+struct BitWriter {
+    unsigned char *out;
+    size_t capacity, bytes;
+    uint64_t pending;
+    int pendingBits;
+    bool overflow;
+};
+
+struct BitReader {
+    const unsigned char *p, *end;
+    uint64_t pending;
+    int pendingBits;
+    bool bad;
+};
+
+void startBits(BitWriter &bits, unsigned char *out, size_t capacity) {
+    bits.out = out;
+    bits.capacity = capacity;
+    bits.bytes = 0;
+    bits.pending = 0;
+    bits.pendingBits = 0;
+    bits.overflow = false;
+}
+
+void putBits(BitWriter &bits, uint32_t value, int width) {
+    bits.pending |= (uint64_t)(value & (uint32_t)((1ull << width) - 1)) << bits.pendingBits;
+    bits.pendingBits += width;
+    while (bits.pendingBits >= 8) {
+        if (bits.bytes < bits.capacity) bits.out[bits.bytes++] = (unsigned char)bits.pending;
+        else bits.overflow = true;
+        bits.pending >>= 8;
+        bits.pendingBits -= 8;
+    }
+}
+
+size_t finishBits(BitWriter &bits) {
+    if (bits.pendingBits > 0) putBits(bits, 0, 8 - bits.pendingBits);
+    return bits.bytes;
+}
+
+void startReading(BitReader &bits, const unsigned char *data, size_t size) {
+    bits.p = data;
+    bits.end = data + size;
+    bits.pending = 0;
+    bits.pendingBits = 0;
+    bits.bad = false;
+}
+
+uint32_t getBits(BitReader &bits, int width) {
+    while (bits.pendingBits < width) {
+        if (bits.p < bits.end) bits.pending |= (uint64_t)*bits.p++ << bits.pendingBits;
+        else bits.bad = true;
+        bits.pendingBits += 8;
+    }
+    uint32_t value = (uint32_t)(bits.pending & ((1ull << width) - 1));
+    bits.pending >>= width;
+    bits.pendingBits -= width;
+    return value;
+}
+
+// ---------------------- Network Snapshots ----------------------
+// What a client needs to draw one tick, quantized for the wire:
+// positions in 1/256 cell (13 bits), board cells in 2 bits, scores in
+// 31 bits so every non-negative int score goes through unchanged
+// Coded against a base state the client has acknowledged: every field
+// sends one "changed" bit, then its new value; a position that moved
+// a little sends an 8-bit signed step instead of all 13 bits
+// The board goes whole in a full snapshot, otherwise only changed cells
+// as a 9-bit index plus value
+// Full snapshots (new client, ack too old) use an all-zero base
+// Packet: type byte, tick and base tick (u32, 0 = full), then the bits
+
+const int POS_BITS = 13;
+const float POS_SCALE = 256.0f;
+const int SCORE_BITS = 31;
+const int NET_HISTORY = 64; // ticks of states kept as delta bases
+const int SNAPSHOT_HEADER = 9;
+
+enum PacketType { PKT_HELLO = 1, PKT_WELCOME, PKT_INPUT, PKT_SNAPSHOT, PKT_PEER_INPUT,
+                  PKT_LOCKSTEP_HELLO, PKT_LOCKSTEP };
+
+struct NetPacman {
+    uint16_t x, y;
+    uint16_t inputSeq; // last key press the server applied for this player
+    uint16_t lives;
+    uint32_t score;
+};
+
+struct NetGhost {
+    uint16_t x, y;
+};
+
+struct NetState {
+    uint32_t tick;
+    uint8_t gameState;
+    uint8_t powerUp; // activePowerUp + 1
+    uint8_t playerCount, ghostCount;
+    uint16_t gameTime;
+    NetPacman players[MAX_PLAYERS];
+    NetGhost ghosts[MAX_GHOSTS];
+    uint8_t board[ROWS][COLS];
+};
+
+inline uint16_t quantizePosition(Fixed v) {
+    return (uint16_t)std::min(std::max(std::lround(fixedToFloat(v) * POS_SCALE), 0L), (long)(1 << POS_BITS) - 1);
+}
+
+void captureNetState(const World &w, uint32_t tick, const uint16_t inputSeqs[MAX_PLAYERS], NetState &state) {
+    std::memset(&state, 0, sizeof(state));
+    state.tick = tick;
+    state.gameState = (uint8_t)w.gameState;
+    state.powerUp = (uint8_t)(w.activePowerUp + 1);
+    state.playerCount = (uint8_t)w.playerCount;
+    state.ghostCount = (uint8_t)std::min(w.ghosts.size(), (size_t)MAX_GHOSTS);
+    state.gameTime = (uint16_t)w.gameTime;
+    each<Position, PlayerStats>(w.pacmen, 0, w.playerCount, [&](size_t p, const Position &pos, const PlayerStats &stats) {
+        state.players[p].x = quantizePosition(pos.x);
+        state.players[p].y = quantizePosition(pos.y);
+        state.players[p].inputSeq = inputSeqs[p];
+        state.players[p].lives = (uint16_t)std::max(0, std::min(stats.lives, 127));
+        state.players[p].score = (uint32_t)std::max(0, stats.score);
+    });
+    each<Position>(w.ghosts, 0, state.ghostCount, [&](size_t i, const Position &pos) {
+        state.ghosts[i].x = quantizePosition(pos.x);
+        state.ghosts[i].y = quantizePosition(pos.y);
+    });
+    for (int i = 0; i < ROWS; i++)
+        for (int j = 0; j < COLS; j++)
+            state.board[i][j] = (uint8_t)w.board[i][j];
+}
+
+void putField(BitWriter &bits, uint32_t value, uint32_t base, int width) {
+    putBits(bits, value != base, 1);
+    if (value != base) putBits(bits, value, width);
+}
+
+uint32_t getField(BitReader &bits, uint32_t base, int width) {
+    return getBits(bits, 1) ? getBits(bits, width) : base;
+}
+
+void putPosition(BitWriter &bits, uint16_t value, uint16_t base) {
+    putBits(bits, value != base, 1);
+    if (value == base) return;
+    int step = (int)value - (int)base;
+    bool small = step >= -128 && step < 128;
+    putBits(bits, small, 1);
+    if (small) putBits(bits, (uint32_t)(step + 128), 8);
+    else putBits(bits, value, POS_BITS);
+}
+
+uint16_t getPosition(BitReader &bits, uint16_t base) {
+    if (!getBits(bits, 1)) return base;
+    if (getBits(bits, 1)) return (uint16_t)(base + (int)getBits(bits, 8) - 128);
+    return (uint16_t)getBits(bits, POS_BITS);
+}
+
+// Returns the packet size; base is null for a full snapshot
+size_t encodeSnapshot(const NetState &state, const NetState *base, unsigned char *out) {
+    static const NetState zero = NetState();
+    const NetState &from = base ? *base : zero;
+    out[0] = PKT_SNAPSHOT;
+    putU32(out + 1, state.tick);
+    putU32(out + 5, base ? base->tick : 0);
+
+    BitWriter bits;
+    startBits(bits, out + SNAPSHOT_HEADER, MAX_PACKET - SNAPSHOT_HEADER);
+    putField(bits, state.gameState, from.gameState, 3);
+    putField(bits, state.powerUp, from.powerUp, 2);
+    putField(bits, state.playerCount, from.playerCount, 3);
+    putField(bits, state.ghostCount, from.ghostCount, 3);
+    putField(bits, state.gameTime, from.gameTime, 16);
+    for (int p = 0; p < state.playerCount; p++) {
+        putPosition(bits, state.players[p].x, from.players[p].x);
+        putPosition(bits, state.players[p].y, from.players[p].y);
+        putField(bits, state.players[p].inputSeq, from.players[p].inputSeq, 16);
+        putField(bits, state.players[p].lives, from.players[p].lives, 7);
+        putField(bits, state.players[p].score, from.players[p].score, SCORE_BITS);
+    }
+    for (int i = 0; i < state.ghostCount; i++) {
+        putPosition(bits, state.ghosts[i].x, from.ghosts[i].x);
+        putPosition(bits, state.ghosts[i].y, from.ghosts[i].y);
+    }
+
+    const uint8_t *cells = &state.board[0][0], *baseCells = &from.board[0][0];
+    if (!base) {
+        for (int c = 0; c < ROWS * COLS; c++) putBits(bits, cells[c], 2);
+    } else {
+        int changed = 0;
+        for (int c = 0; c < ROWS * COLS; c++) changed += cells[c] != baseCells[c];
+        putBits(bits, changed, 9);
+        for (int c = 0; c < ROWS * COLS; c++) {
+            if (cells[c] == baseCells[c]) continue;
+            putBits(bits, c, 9);
+            putBits(bits, cells[c], 2);
+        }
+    }
+    return SNAPSHOT_HEADER + finishBits(bits);
+}
+
+// Decodes against base (null for a full snapshot); false if malformed
+bool decodeSnapshot(const unsigned char *data, size_t size, const NetState *base, NetState &state) {
+    static const NetState zero = NetState();
+    const NetState &from = base ? *base : zero;
+    if (size < (size_t)SNAPSHOT_HEADER || data[0] != PKT_SNAPSHOT) return false;
+    state = from;
+    state.tick = getU32(data + 1);
+
+    BitReader bits;
+    startReading(bits, data + SNAPSHOT_HEADER, size - SNAPSHOT_HEADER);
+    state.gameState = (uint8_t)getField(bits, from.gameState, 3);
+    state.powerUp = (uint8_t)getField(bits, from.powerUp, 2);
+    state.playerCount = (uint8_t)getField(bits, from.playerCount, 3);
+    state.ghostCount = (uint8_t)getField(bits, from.ghostCount, 3);
+    state.gameTime = (uint16_t)getField(bits, from.gameTime, 16);
+    if (state.playerCount > MAX_PLAYERS || state.ghostCount > MAX_GHOSTS) return false;
+    for (int p = 0; p < state.playerCount; p++) {
+        state.players[p].x = getPosition(bits, from.players[p].x);
+        state.players[p].y = getPosition(bits, from.players[p].y);
+        state.players[p].inputSeq = (uint16_t)getField(bits, from.players[p].inputSeq, 16);
+        state.players[p].lives = (uint16_t)getField(bits, from.players[p].lives, 7);
+        state.players[p].score = getField(bits, from.players[p].score, SCORE_BITS);
+    }
+    for (int i = 0; i < state.ghostCount; i++) {
+        state.ghosts[i].x = getPosition(bits, from.ghosts[i].x);
+        state.ghosts[i].y = getPosition(bits, from.ghosts[i].y);
+    }
+
+    for (int p = state.playerCount; p < MAX_PLAYERS; p++) state.players[p] = NetPacman();
+    for (int i = state.ghostCount; i < MAX_GHOSTS; i++) state.ghosts[i] = NetGhost();
+
+    uint8_t *cells = &state.board[0][0];
+    if (!base) {
+        for (int c = 0; c < ROWS * COLS; c++) cells[c] = (uint8_t)getBits(bits, 2);
+    } else {
+        int changed = (int)getBits(bits, 9);
+        for (int k = 0; k < changed; k++) {
+            int c = (int)getBits(bits, 9);
+            uint8_t value = (uint8_t)getBits(bits, 2);
+            if (c >= ROWS * COLS) return false;
+            cells[c] = value;
+        }
+    }
+    return !bits.bad;
+}
+
+// The states a client compares against, entry = tick % NET_HISTORY
+const NetState *historyState(const NetState *history, uint32_t tick) {
+    const NetState &state = history[tick % NET_HISTORY];
+    return tick != 0 && state.tick == tick ? &state : 0;
+}
+
+
+// ---------------------- Multiplayer Server ----------------------
+// --server PORT runs the authoritative game headless; no window
+// Each client that says hello gets the next free Pacman (up to 4)
+// Clients send numbered key presses and the last tick they decoded;
+// each tick the server applies new presses, steps the game, keeps its
+// quantized state in a NET_HISTORY ring and sends every client a delta
+// against that client's last acknowledged state
+// The game starts with the first player and restarts 3 s after it ends
+// Clients silent for 3 s are dropped: their Pacman leaves play, the slot
+// is free for the next hello and the player count shrinks to match
+// Every 5 s logs bytes per tick and tick time per player to stderr
+
+const int NET_TIMEOUT_SECONDS = 3;
+const int NET_RESTART_SECONDS = 3;
+const int NET_REPORT_SECONDS = 5;
+const int MAX_INPUTS_PER_PACKET = 16;
+
+struct NetClient {
+    bool connected;
+    sockaddr_in addr;
+    uint32_t ackTick;
+    uint16_t inputSeq; // last key press applied
+    Clock::time_point lastHeard;
+};
+
+struct NetServer {
+    NetSocket sock;
+    World world;
+    NetClient clients[MAX_PLAYERS];
+    NetState history[NET_HISTORY];
+    uint32_t tick;
+    Clock::time_point gameEnded;
+    uint64_t bytesSent, playerTicks, ticks;
+    double tickSeconds;
+} netServer;
+
+inline bool seqNewer(uint16_t a, uint16_t b) {
+    return (int16_t)(a - b) > 0;
+}
+
+void applyNetKey(World &w, int player, unsigned char key) {
+    if (w.gameState != PLAYING) return;
+    switch (key) {
+        case 'w': case 'W': queueTurn(w, player, 0, 1, Clock::now()); break;
+        case 's': case 'S': queueTurn(w, player, 0, -1, Clock::now()); break;
+        case 'a': case 'A': queueTurn(w, player, -1, 0, Clock::now()); break;
+        case 'd': case 'D': queueTurn(w, player, 1, 0, Clock::now()); break;
+    }
+}
+
+int connectedPlayerCount(const NetServer &server) {
+    int count = 0;
+    for (int p = 0; p < MAX_PLAYERS; p++) {
+        if (server.clients[p].connected) count = p + 1;
+    }
+    return count;
+}
+
+void dropClient(NetServer &server, int player) {
+    server.clients[player].connected = false;
+    World &w = server.world;
+    w.pacmen.get<PlayerStats>(player).lives = 0; // out of play; the others keep going
+    w.pacmen.get<Motion>(player).dirX = 0; w.pacmen.get<Motion>(player).dirY = 0;
+    w.pacmen.get<Steering>(player).hasQueuedTurn = false;
+    int players = connectedPlayerCount(server);
+    if (players > 0) w.playerCount = players;
+}
+
+void handleServerPacket(NetServer &server, const unsigned char *data, int size, const sockaddr_in &from) {
+    int player = -1;
+    for (int p = 0; p < MAX_PLAYERS; p++) {
+        if (server.clients[p].connected && sameAddress(server.clients[p].addr, from)) player = p;
+    }
+
+    if (data[0] == PKT_HELLO) {
+        for (int p = 0; p < MAX_PLAYERS && player < 0; p++) {
+            if (server.clients[p].connected) continue;
+            NetClient &client = server.clients[p];
+            client.connected = true;
+            client.addr = from;
+            client.ackTick = 0;
+            client.inputSeq = 0;
+            player = p;
+            World &w = server.world;
+            if (w.gameState == PLAYING) {
+                w.playerCount = std::max(w.playerCount, p + 1);
+                spawnPacman(w, p);
+                w.pacmen.get<PlayerStats>(p).score = 0;
+                w.pacmen.get<PlayerStats>(p).lives = settings.startLives;
+            }
+            std::fprintf(stderr, "server: player %d joined\n", p + 1);
+        }
+        if (player < 0) return; // full; the client keeps asking
+        server.clients[player].lastHeard = Clock::now();
+        unsigned char welcome[2] = { PKT_WELCOME, (unsigned char)player };
+        sendPacket(server.sock, from, welcome, sizeof(welcome));
+        return;
+    }
+    if (data[0] != PKT_INPUT || player < 0 || size < 6) return;
+
+    NetClient &client = server.clients[player];
+    client.lastHeard = Clock::now();
+    uint32_t ack = getU32(data + 1);
+    if (ack > client.ackTick && ack <= server.tick) client.ackTick = ack;
+    int count = std::min((int)data[5], (size - 6) / 3);
+    for (int i = 0; i < count; i++) {
+        const unsigned char *input = data + 6 + i * 3;
+        uint16_t seq = (uint16_t)(input[0] | input[1] << 8);
+        if (!seqNewer(seq, client.inputSeq)) continue;
+        client.inputSeq = seq;
+        applyNetKey(server.world, player, input[2]);
+    }
+}
+
+void serverTick(NetServer &server, Fixed dt) {
+    Clock::time_point start = Clock::now();
+    unsigned char packet[MAX_PACKET];
+    sockaddr_in from;
+    while (int size = receivePacket(server.sock, packet, from)) {
+        handleServerPacket(server, packet, size, from);
+    }
+
+    World &w = server.world;
+    for (int p = 0; p < MAX_PLAYERS; p++) {
+        NetClient &client = server.clients[p];
+        if (client.connected && start - client.lastHeard > std::chrono::seconds(NET_TIMEOUT_SECONDS)) {
+            dropClient(server, p);
+            std::fprintf(stderr, "server: player %d timed out\n", p + 1);
+        }
+    }
+    int players = connectedPlayerCount(server);
+    if (players == 0) {
+        if (w.gameState != MENU) resetGame(w);
+    } else if (w.gameState == MENU ||
+               (w.gameState != PLAYING && start - server.gameEnded > std::chrono::seconds(NET_RESTART_SECONDS))) {
+        startNewGame(w);
+        w.playerCount = players;
+    }
+    GameState before = w.gameState;
+    updateGame(w, dt);
+    if (before == PLAYING && w.gameState != PLAYING) server.gameEnded = start;
+
+    server.tick++;
+    uint16_t inputSeqs[MAX_PLAYERS];
+    for (int p = 0; p < MAX_PLAYERS; p++) inputSeqs[p] = server.clients[p].inputSeq;
+    NetState &state = server.history[server.tick % NET_HISTORY];
+    captureNetState(w, server.tick, inputSeqs, state);
+
+    for (int p = 0; p < MAX_PLAYERS; p++) {
+        NetClient &client = server.clients[p];
+        if (!client.connected) continue;
+        const NetState *base = 0;
+        if (server.tick - client.ackTick < NET_HISTORY) base = historyState(server.history, client.ackTick);
+        size_t size = encodeSnapshot(state, base, packet);
+        sendPacket(server.sock, client.addr, packet, size);
+        server.bytesSent += size;
+        server.playerTicks++;
+    }
+    server.ticks++;
+    server.tickSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void reportServerStats(NetServer &server) {
+    if (server.ticks == 0) return;
+    std::fprintf(stderr, "server: %d players, %.1f bytes/tick (%.1f per player), tick %.1f us (%.1f us per player)\n",
+                 connectedPlayerCount(server), (double)server.bytesSent / server.ticks,
+                 server.playerTicks ? (double)server.bytesSent / server.playerTicks : 0.0,
+                 server.tickSeconds / server.ticks * 1e6,
+                 server.playerTicks ? server.tickSeconds / server.playerTicks * 1e6 : 0.0);
+    server.bytesSent = server.playerTicks = server.ticks = 0;
+    server.tickSeconds = 0;
+}
+
+bool openServer(NetServer &server, uint16_t port) {
+    server.sock = openUdpSocket(port);
+    if (server.sock == NO_SOCKET) {
+        std::cerr << "Cannot open UDP port " << port << std::endl;
+        return false;
+    }
+    server.world.live = false;
+    resetGame(server.world);
+    return true;
+}
+
+int runServer(uint16_t port) {
+    persistScores = false;
+    if (!startNetworking() || !openServer(netServer, port)) return 1;
+    std::fprintf(stderr, "server: listening on UDP port %u at %d Hz\n", socketPort(netServer.sock), settings.simHz);
+
+    const Clock::duration tick = tickDuration();
+    const Fixed dt = tickFixed();
+    Clock::time_point next = Clock::now();
+    Clock::time_point nextReport = next + std::chrono::seconds(NET_REPORT_SECONDS);
+    while (true) {
+        Clock::time_point now = Clock::now();
+        if (now < next) {
+            waitForPacket(netServer.sock, (long)std::chrono::duration_cast<std::chrono::microseconds>(next - now).count());
+            continue;
+        }
+        if (now - next > std::chrono::milliseconds(250)) next = now; // stalled; resync
+        serverTick(netServer, dt);
+        next += tick;
+        if (now >= nextReport) {
+            reportServerStats(netServer);
+            nextReport += std::chrono::seconds(NET_REPORT_SECONDS);
+        }
+    }
+}
+
+// ---------------------- Multiplayer Client ----------------------
+// --client HOST:PORT opens the usual window but runs no simulation;
+// a network thread turns server snapshots into FrameSnapshots for the
+// unchanged renderer and sends key presses from the input queue
+// Key presses are numbered and resent with every packet until a
+// snapshot shows the server applied them, so lost packets lose no keys
+// Decoded states are kept in a ring as bases for the next deltas
+
+struct NetPeer {
+    NetSocket sock;
+    sockaddr_in server;
+    int player; // -1 until welcomed
+    NetState states[NET_HISTORY];
+    uint32_t latestTick;
+    uint16_t nextInputSeq;
+    uint16_t pendingSeqs[MAX_INPUTS_PER_PACKET];
+    unsigned char pendingKeys[MAX_INPUTS_PER_PACKET];
+    int pendingCount;
+    uint64_t bytesReceived, snapshots, fullSnapshots, undecodable;
+};
+
+bool openPeer(NetPeer &peer, const sockaddr_in &server) {
+    std::memset(&peer, 0, sizeof(peer));
+    peer.server = server;
+    peer.player = -1;
+    peer.sock = openUdpSocket(0);
+    return peer.sock != NO_SOCKET;
+}
+
+void queuePeerKey(NetPeer &peer, unsigned char key) {
+    if (peer.pendingCount == MAX_INPUTS_PER_PACKET) { // drop the oldest
+        std::memmove(peer.pendingSeqs, peer.pendingSeqs + 1, (MAX_INPUTS_PER_PACKET - 1) * sizeof(uint16_t));
+        std::memmove(peer.pendingKeys, peer.pendingKeys + 1, MAX_INPUTS_PER_PACKET - 1);
+        peer.pendingCount--;
+    }
+    peer.pendingSeqs[peer.pendingCount] = ++peer.nextInputSeq;
+    peer.pendingKeys[peer.pendingCount] = key;
+    peer.pendingCount++;
+}
+
+void sendPeerUpdate(NetPeer &peer) {
+    unsigned char packet[6 + 3 * MAX_INPUTS_PER_PACKET];
+    if (peer.player < 0) {
+        packet[0] = PKT_HELLO;
+        sendPacket(peer.sock, peer.server, packet, 1);
+        return;
+    }
+    packet[0] = PKT_INPUT;
+    putU32(packet + 1, peer.latestTick);
+    packet[5] = (unsigned char)peer.pendingCount;
+    for (int i = 0; i < peer.pendingCount; i++) {
+        unsigned char *input = packet + 6 + i * 3;
+        input[0] = (unsigned char)peer.pendingSeqs[i];
+        input[1] = (unsigned char)(peer.pendingSeqs[i] >> 8);
+        input[2] = peer.pendingKeys[i];
+    }
+    sendPacket(peer.sock, peer.server, packet, 6 + 3 * peer.pendingCount);
+}
+
+// Handles one packet; true when it brought a newer state
+bool handlePeerPacket(NetPeer &peer, const unsigned char *data, int size) {
+    if (data[0] == PKT_WELCOME && size >= 2) {
+        peer.player = data[1];
+        return false;
+    }
+    if (data[0] != PKT_SNAPSHOT || size < SNAPSHOT_HEADER) return false;
+    uint32_t tick = getU32(data + 1);
+    uint32_t baseTick = getU32(data + 5);
+    if (tick <= peer.latestTick) return false; // late or duplicate
+
+    const NetState *base = 0;
+    if (baseTick != 0 && !(base = historyState(peer.states, baseTick))) {
+        peer.undecodable++;
+        return false;
+    }
+    NetState state;
+    if (!decodeSnapshot(data, size, base, state)) {
+        peer.undecodable++;
+        return false;
+    }
+    peer.states[tick % NET_HISTORY] = state;
+    peer.latestTick = tick;
+    peer.bytesReceived += size;
+    peer.snapshots++;
+    if (!base) peer.fullSnapshots++;
+
+    // Drop key presses the server has applied
+    if (peer.player >= 0 && peer.player < state.playerCount) {
+        uint16_t applied = state.players[peer.player].inputSeq;
+        int keep = 0;
+        for (int i = 0; i < peer.pendingCount; i++) {
+            if (!seqNewer(peer.pendingSeqs[i], applied)) continue;
+            peer.pendingSeqs[keep] = peer.pendingSeqs[i];
+            peer.pendingKeys[keep] = peer.pendingKeys[i];
+            keep++;
+        }
+        peer.pendingCount = keep;
+    }
+    return true;
+}
+
+std::string clientAddress;
+std::atomic<bool> clientRunning(false);
+std::thread clientThread;
+
+void publishNetState(const NetState &state) {
+    FrameSnapshot &snap = snapshots.writeSlot();
+    snap.gameState = state.gameState <= HIGHSCORE ? (GameState)state.gameState : MENU;
+    for (int i = 0; i < ROWS; i++)
+        for (int j = 0; j < COLS; j++)
+            snap.board[i][j] = state.board[i][j];
+    snap.playerCount = state.playerCount;
+    snap.score = snap.lives = 0;
+    for (int p = 0; p < state.playerCount; p++) {
+        PacmanView &pac = snap.pacmen[p];
+        pac.x = state.players[p].x / POS_SCALE;
+        pac.y = state.players[p].y / POS_SCALE;
+        pac.score = (int)state.players[p].score;
+        pac.lives = state.players[p].lives;
+        snap.score += pac.score;
+        snap.lives += pac.lives;
+    }
+    snap.ghostCount = std::min((int)state.ghostCount, MAX_GHOSTS);
+    for (int i = 0; i < snap.ghostCount; i++) {
+        GhostView &view = snap.ghosts[i];
+        view.x = state.ghosts[i].x / POS_SCALE;
+        view.y = state.ghosts[i].y / POS_SCALE;
+        setGhostColor(view, i);
+    }
+    snap.activePowerUp = (int)state.powerUp - 1;
+    snap.gameTime = state.gameTime;
+    snap.inputsHandled = inputsHandled;
+    snapshots.publish();
+}
+
+void clientLoop() {
+    nameTraceThread("network");
+    sockaddr_in server;
+    NetPeer *peer = new NetPeer();
+    if (!resolveAddress(clientAddress, server) || !openPeer(*peer, server)) {
+        std::cerr << "Cannot reach server " << clientAddress << std::endl;
+        delete peer;
+        return;
+    }
+    Clock::time_point lastSent;
+    unsigned char packet[MAX_PACKET];
+    sockaddr_in from;
+    while (clientRunning.load(std::memory_order_relaxed)) {
+        waitForPacket(peer->sock, 10000);
+        bool fresh = false;
+        while (int size = receivePacket(peer->sock, packet, from)) {
+            if (sameAddress(from, server)) fresh |= handlePeerPacket(*peer, packet, size);
+        }
+        if (fresh) publishNetState(peer->states[peer->latestTick % NET_HISTORY]);
+
+        InputEvent event;
+        bool keys = false;
+        while (inputQueue.pop(event)) {
+            queuePeerKey(*peer, event.key);
+            inputsHandled++;
+            keys = true;
+        }
+        Clock::time_point now = Clock::now();
+        if (fresh || keys || now - lastSent > std::chrono::milliseconds(100)) {
+            sendPeerUpdate(*peer);
+            lastSent = now;
+        }
+    }
+    closeSocket(peer->sock);
+    delete peer;
+}
+
+void startNetClient(const std::string &address) {
+    clientAddress = address;
+    if (!startNetworking()) return;
+    publishSnapshot(); // the menu until the first snapshot arrives
+    clientRunning = true;
+    clientThread = std::thread(clientLoop);
+}
+
+void stopNetClient() {
+    clientRunning = false;
+    if (clientThread.joinable()) clientThread.join();
+}
+
+// ---------------------- Network Loopback Test ----------------------
+// Run with --net-test [PLAYERS]; no window
+// Server and bot clients share one thread and talk over 127.0.0.1, so
+// every decoded snapshot can be checked against the server's own state
+// Bots join a second apart, turn at random every half second and drop
+// 10% of incoming packets to exercise acks and full-snapshot fallback
+// Reports bytes per tick, full vs delta sizes and server tick time
+// per player; fails if any decoded state differs from the server's
+
+int runNetTest(int players) {
+    const int TICKS = 60 * settings.simHz;
+    players = std::max(1, std::min(players, MAX_PLAYERS));
+    persistScores = false;
+    if (!startNetworking() || !openServer(netServer, 0)) return 1;
+
+    sockaddr_in server;
+    resolveAddress(intToString(socketPort(netServer.sock)), server);
+    std::vector<NetPeer> bots(players);
+    for (int b = 0; b < players; b++) {
+        if (!openPeer(bots[b], server)) {
+            std::cerr << "Cannot open client socket" << std::endl;
+            return 1;
+        }
+    }
+
+    const Fixed dt = tickFixed();
+    const char keys[4] = { 'w', 'a', 's', 'd' };
+    unsigned char packet[MAX_PACKET];
+    sockaddr_in from;
+    unsigned int rng = 12345;
+    uint64_t mismatches = 0, dropped = 0;
+    for (int t = 0; t < TICKS; t++) {
+        serverTick(netServer, dt);
+        for (int b = 0; b < players; b++) {
+            NetPeer &bot = bots[b];
+            if (t < b * settings.simHz) continue; // not joined yet
+            while (int size = receivePacket(bot.sock, packet, from)) {
+                if (packet[0] == PKT_SNAPSHOT && nextRandom(rng) % 10 == 0) {
+                    dropped++;
+                    continue;
+                }
+                if (!handlePeerPacket(bot, packet, size)) continue;
+                const NetState &mine = bot.states[bot.latestTick % NET_HISTORY];
+                const NetState *truth = historyState(netServer.history, bot.latestTick);
+                if (!truth || std::memcmp(truth, &mine, sizeof(mine)) != 0) mismatches++;
+            }
+            if (bot.player >= 0 && t % (settings.simHz / 2 + 1) == 0) {
+                queuePeerKey(bot, keys[nextRandom(rng) % 4]);
+            }
+            sendPeerUpdate(bot);
+        }
+    }
+
+    uint64_t bytes = 0, snaps = 0, fulls = 0, undecodable = 0;
+    for (int b = 0; b < players; b++) {
+        bytes += bots[b].bytesReceived;
+        snaps += bots[b].snapshots;
+        fulls += bots[b].fullSnapshots;
+        undecodable += bots[b].undecodable;
+    }
+    NetState full;
+    uint16_t noInputs[MAX_PLAYERS] = {};
+    captureNetState(netServer.world, netServer.tick, noInputs, full);
+    unsigned char scratch[MAX_PACKET];
+    size_t fullSize = encodeSnapshot(full, 0, scratch);
+
+    std::printf("%d players, %u ticks: %llu snapshots decoded (%llu full), %llu dropped, %llu undecodable\n",
+                players, netServer.tick, (unsigned long long)snaps, (unsigned long long)fulls,
+                (unsigned long long)dropped, (unsigned long long)undecodable);
+    std::printf("%.1f bytes per decoded snapshot (a full one is %u), %.1f bytes/tick sent to all players\n",
+                snaps ? (double)bytes / snaps : 0.0, (unsigned)fullSize,
+                (double)netServer.bytesSent / netServer.ticks);
+    std::printf("server tick %.2f us, %.2f us per player\n",
+                netServer.tickSeconds / netServer.ticks * 1e6,
+                netServer.playerTicks ? netServer.tickSeconds / netServer.playerTicks * 1e6 : 0.0);
+    std::printf("%llu decoded states differ from the server's\n", (unsigned long long)mismatches);
+    for (int b = 0; b < players; b++) closeSocket(bots[b].sock);
+    closeSocket(netServer.sock);
+    return mismatches ? 2 : 0;
+}
+
+// ---------------------- Rollback Netcode ----------------------
+// --peer PORT HOST:PORT plays a two-player game peer to peer, no server
+// Both peers run the whole game and send only their own key presses,
+// each tagged with the tick it applies on
+// The other player's keys for ticks not heard from yet are predicted as
+// "none"; when the real ones arrive and differ, the game is restored from
+// the GameImage saved before that tick and resimulated to the present
+// before the frame is published
+// States cover the last ROLLBACK_WINDOW ticks; a peer that gets that far
+// past the other's confirmed input waits for it instead of predicting
+// A peer running ahead of the other holds a tick now and then
+// Each peer proposes a random seed; the higher one is player 1 and its
+// seed starts the game; later games restart 3 s after one ends, seeded
+// from the game's own RNG so the peers never need to agree on anything
+// Inputs are resent until acknowledged, so losing packets only delays them
+
+const int ROLLBACK_WINDOW = 32;                   // saved states, in ticks
+const int ROLLBACK_INPUTS = 2 * ROLLBACK_WINDOW;  // keys kept per player
+const int ROLLBACK_PLAYERS = 2;
+const int PEER_PACKET_HEADER = 18;
+const uint32_t NO_ROLLBACK = 0xFFFFFFFFu;
+
+// Key codes carried per tick: 0 none, 1..4 = TURN_DIRS index + 1
+uint8_t turnKeyCode(unsigned char key) {
+    switch (key) {
+        case 'w': case 'W': return 1;
+        case 's': case 'S': return 2;
+        case 'a': case 'A': return 3;
+        case 'd': case 'D': return 4;
+    }
+    return 0;
+}
+
+struct RollbackSession {
+    World *world;
+    int localPlayer, remotePlayer; // -1 until the peers have met
+    uint32_t localSeed, seed;
+    uint32_t tick;          // next tick to simulate
+    uint32_t confirmedTick; // remote keys known for every tick below this
+    uint32_t remoteTick;    // the remote's next tick, as last reported
+    uint32_t remoteAck;     // the remote has our keys for ticks below this
+    uint32_t rollbackFrom;  // earliest mispredicted tick
+    uint32_t idleTicks;     // ticks since the game stopped playing
+    float skew;             // ticks this peer runs ahead, smoothed
+    GameImage states[ROLLBACK_WINDOW];   // state before tick t at t % window
+    uint32_t idleAt[ROLLBACK_WINDOW];
+    uint8_t keys[ROLLBACK_INPUTS][ROLLBACK_PLAYERS];
+    uint64_t rollbacks, resimulated, stalls, holds;
+    uint32_t deepest;
+    double resimSeconds, worstResimSeconds;
+};
+
+void openRollback(RollbackSession &s, World &w, uint32_t localSeed) {
+    std::memset(&s, 0, sizeof(s));
+    s.world = &w;
+    s.localPlayer = s.remotePlayer = -1;
+    s.localSeed = localSeed | 1u; // 0 means "no seed" on the wire
+    s.rollbackFrom = NO_ROLLBACK;
+    w.live = false; // resimulated ticks must not log or record twice
+    resetGame(w);
+}
+
+bool rollbackStarted(const RollbackSession &s) {
+    return s.localPlayer >= 0;
+}
+
+// Runs tick t on the world as it stands, saving the state before it
+void simulateRollbackTick(RollbackSession &s, uint32_t t, Fixed dt) {
+    World &w = *s.world;
+    captureGameImage(w, s.states[t % ROLLBACK_WINDOW]);
+    s.idleAt[t % ROLLBACK_WINDOW] = s.idleTicks;
+
+    if (w.gameState != PLAYING && ++s.idleTicks >= (uint32_t)(NET_RESTART_SECONDS * settings.simHz)) {
+        startNewGame(w, nextRandom(w.gameRng));
+        w.playerCount = ROLLBACK_PLAYERS;
+    }
+    if (w.gameState == PLAYING) s.idleTicks = 0;
+    for (int p = 0; p < ROLLBACK_PLAYERS; p++) {
+        uint8_t code = s.keys[t % ROLLBACK_INPUTS][p];
+        if (code && w.gameState == PLAYING) {
+            queueTurn(w, p, TURN_DIRS[code - 1][0], TURN_DIRS[code - 1][1], Clock::time_point());
+        }
+    }
+    updateGame(w, dt);
+}
+
+// Restores the first mispredicted tick and replays up to the present
+void resimulate(RollbackSession &s, Fixed dt) {
+    if (s.rollbackFrom >= s.tick) {
+        s.rollbackFrom = NO_ROLLBACK;
+        return;
+    }
+    TRACE_SCOPE("rollback");
+    Clock::time_point start = Clock::now();
+    uint32_t from = s.rollbackFrom;
+    applyGameImage(*s.world, s.states[from % ROLLBACK_WINDOW]);
+    s.idleTicks = s.idleAt[from % ROLLBACK_WINDOW];
+    for (uint32_t t = from; t < s.tick; t++) simulateRollbackTick(s, t, dt);
+    s.rollbackFrom = NO_ROLLBACK;
+
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    s.rollbacks++;
+    s.resimulated += s.tick - from;
+    s.deepest = std::max(s.deepest, s.tick - from);
+    s.resimSeconds += seconds;
+    s.worstResimSeconds = std::max(s.worstResimSeconds, seconds);
+}
+
+// Simulates the next tick with the local key and a prediction for the
+// remote one; false (key kept by the caller) when too far ahead to predict
+bool advanceRollback(RollbackSession &s, uint8_t localKey, Fixed dt) {
+    if (s.tick + 1 >= s.confirmedTick + ROLLBACK_WINDOW) {
+        s.stalls++;
+        return false;
+    }
+    uint8_t *keys = s.keys[s.tick % ROLLBACK_INPUTS];
+    keys[s.localPlayer] = localKey;
+    if (s.tick >= s.confirmedTick) keys[s.remotePlayer] = 0; // predicted
+    simulateRollbackTick(s, s.tick, dt);
+    s.tick++;
+    return true;
+}
+
+// True when this peer runs ahead of the other; both see the same latency,
+// so half the difference of their leads is the skew, smoothed over jitter
+bool rollbackShouldHold(RollbackSession &s) {
+    int ours = (int)(s.tick - s.remoteTick);
+    int theirs = (int)(s.remoteTick - s.remoteAck);
+    s.skew += ((ours - theirs) * 0.5f - s.skew) * 0.05f;
+    if (s.skew < 1.5f) return false;
+    s.skew -= 1.0f; // this hold makes up one tick of it
+    s.holds++;
+    return true;
+}
+
+size_t encodePeerPacket(const RollbackSession &s, unsigned char *out) {
+    uint32_t first = std::max(s.remoteAck, s.tick > (uint32_t)ROLLBACK_INPUTS ? s.tick - ROLLBACK_INPUTS : 0u);
+    uint32_t count = rollbackStarted(s) ? std::min(s.tick - first, 255u) : 0;
+    out[0] = PKT_PEER_INPUT;
+    putU32(out + 1, s.localSeed);
+    putU32(out + 5, s.tick);
+    putU32(out + 9, s.confirmedTick);
+    putU32(out + 13, first);
+    out[17] = (unsigned char)count;
+    for (uint32_t i = 0; i < count; i++) {
+        out[PEER_PACKET_HEADER + i] = s.keys[(first + i) % ROLLBACK_INPUTS][s.localPlayer];
+    }
+    return PEER_PACKET_HEADER + count;
+}
+
+void handlePeerInput(RollbackSession &s, const unsigned char *data, int size) {
+    if (size < PEER_PACKET_HEADER || data[0] != PKT_PEER_INPUT) return;
+    uint32_t remoteSeed = getU32(data + 1);
+    if (!rollbackStarted(s)) {
+        if (remoteSeed == s.localSeed) { // a tie; one side redraws
+            s.localSeed = ((uint32_t)rand() ^ (uint32_t)Clock::now().time_since_epoch().count()) | 1u;
+            return;
+        }
+        s.localPlayer = s.localSeed > remoteSeed ? 0 : 1;
+        s.remotePlayer = 1 - s.localPlayer;
+        s.seed = std::max(s.localSeed, remoteSeed);
+        startNewGame(*s.world, s.seed);
+        s.world->playerCount = ROLLBACK_PLAYERS;
+    }
+
+    uint32_t tick = getU32(data + 5), ack = getU32(data + 9);
+    uint32_t first = getU32(data + 13), count = data[17];
+    if (tick > s.remoteTick) s.remoteTick = tick;
+    if (ack > s.remoteAck && ack <= s.tick) s.remoteAck = ack;
+    if (first > s.confirmedTick || (int)count > size - PEER_PACKET_HEADER) return; // a gap; wait for a resend
+    for (uint32_t t = s.confirmedTick; t < first + count; t++) {
+        uint8_t code = data[PEER_PACKET_HEADER + (t - first)];
+        if (code > 4) code = 0;
+        uint8_t &slot = s.keys[t % ROLLBACK_INPUTS][s.remotePlayer];
+        if (t < s.tick && slot != code) s.rollbackFrom = std::min(s.rollbackFrom, t);
+        slot = code;
+    }
+    s.confirmedTick = std::max(s.confirmedTick, first + count);
+}
+
+RollbackSession peerSession;
+std::string peerAddress;
+uint16_t peerPort;
+std::atomic<bool> peerRunning(false);
+std::thread peerThread;
+
+void peerLoop() {
+    nameTraceThread("rollback");
+    sockaddr_in remote, from;
+    NetSocket sock = openUdpSocket(peerPort);
+    if (sock == NO_SOCKET || !resolveAddress(peerAddress, remote)) {
+        std::cerr << "Cannot open UDP port " << peerPort << " or reach " << peerAddress << std::endl;
+        return;
+    }
+    RollbackSession &s = peerSession;
+    const Clock::duration tick = tickDuration();
+    const Fixed dt = tickFixed();
+    Clock::time_point next = Clock::now(), lastHello;
+    unsigned char packet[MAX_PACKET];
+    uint8_t localKey = 0;
+
+    while (peerRunning.load(std::memory_order_relaxed)) {
+        while (int size = receivePacket(sock, packet, from)) {
+            if (sameAddress(from, remote)) handlePeerInput(s, packet, size);
+        }
+        InputEvent event;
+        while (inputQueue.pop(event)) {
+            if (uint8_t code = turnKeyCode(event.key)) localKey = code;
+            inputsHandled++;
+        }
+
+        Clock::time_point now = Clock::now();
+        if (!rollbackStarted(s)) {
+            if (now - lastHello > std::chrono::milliseconds(100)) {
+                sendPacket(sock, remote, packet, encodePeerPacket(s, packet));
+                lastHello = now;
+            }
+            next = now;
+        } else if (now >= next) {
+            resimulate(s, dt);
+            if (!rollbackShouldHold(s) && advanceRollback(s, localKey, dt)) localKey = 0;
+            writeSpectatorTick(game);
+            sendPacket(sock, remote, packet, encodePeerPacket(s, packet));
+            publishSnapshot();
+            next += tick;
+            if (now - next > std::chrono::milliseconds(250)) next = now;
+            continue;
+        }
+        waitForPacket(sock, rollbackStarted(s) ?
+                      (long)std::chrono::duration_cast<std::chrono::microseconds>(next - now).count() : 100000);
+    }
+    closeSocket(sock);
+}
+
+void startPeer(uint16_t port, const std::string &address) {
+    peerPort = port;
+    peerAddress = address;
+    if (!startNetworking()) return;
+    openRollback(peerSession, game, (uint32_t)rand() ^ (uint32_t)Clock::now().time_since_epoch().count());
+    publishSnapshot();
+    peerRunning = true;
+    peerThread = std::thread(peerLoop);
+}
+
+void stopPeer() {
+    peerRunning = false;
+    if (peerThread.joinable()) peerThread.join();
+}
+
+// ---------------------- Rollback Test ----------------------
+// Run with --rollback-test [LATENCY_MS]; no window
+// Two peers in one thread, each with its own World and UDP socket on
+// 127.0.0.1, pressing random keys; every packet is held back for the
+// latency plus up to 50% jitter and 5% are lost, so predictions miss
+// Time is simulated tick by tick, so the run takes no wall time to wait
+// Every tick both peers have confirmed is checksummed on each side and
+// the two must agree; then restoring and resimulating 10 ticks is timed
+// on its own and must take under 1 ms (p99)
+
+struct DelayedPacket {
+    uint32_t due;
+    int to;
+    size_t size;
+    unsigned char data[MAX_PACKET];
+};
+
+int runRollbackTest(int latencyMs) {
+    const uint32_t TICKS = 60 * settings.simHz;
+    const Fixed dt = tickFixed();
+    const int latency = std::max(0, latencyMs) * settings.simHz / 1000;
+    persistScores = false;
+    if (!startNetworking()) return 1;
+
+    World worlds[ROLLBACK_PLAYERS];
+    RollbackSession *peers = new RollbackSession[ROLLBACK_PLAYERS];
+    NetSocket socks[ROLLBACK_PLAYERS];
+    sockaddr_in addrs[ROLLBACK_PLAYERS];
+    std::vector<uint32_t> checksums[ROLLBACK_PLAYERS];
+    for (int i = 0; i < ROLLBACK_PLAYERS; i++) {
+        openRollback(peers[i], worlds[i], 1000u + 1000u * i);
+        socks[i] = openUdpSocket(0);
+        if (socks[i] == NO_SOCKET) {
+            std::cerr << "Cannot open UDP socket" << std::endl;
+            return 1;
+        }
+        resolveAddress(intToString(socketPort(socks[i])), addrs[i]);
+    }
+
+    std::vector<DelayedPacket> inFlight;
+    unsigned int rng = 777;
+    unsigned char packet[MAX_PACKET];
+    sockaddr_in from;
+    uint64_t lost = 0, sent = 0;
+    for (uint32_t now = 0; now < TICKS + 4 * (uint32_t)latency + 60; now++) {
+        // Deliver what is due over the real sockets, then read it back
+        for (size_t k = 0; k < inFlight.size();) {
+            if (inFlight[k].due > now) { k++; continue; }
+            sendPacket(socks[1 - inFlight[k].to], addrs[inFlight[k].to], inFlight[k].data, inFlight[k].size);
+            inFlight[k] = inFlight.back();
+            inFlight.pop_back();
+        }
+        for (int i = 0; i < ROLLBACK_PLAYERS; i++) {
+            while (int size = receivePacket(socks[i], packet, from)) handlePeerInput(peers[i], packet, size);
+        }
+
+        for (int i = 0; i < ROLLBACK_PLAYERS; i++) {
+            RollbackSession &s = peers[i];
+            if (i == 1 && now < 5) continue; // the second peer comes up late
+            if (rollbackStarted(s)) {
+                resimulate(s, dt);
+                uint8_t key = now < TICKS && nextRandom(rng) % 8 == 0 ? (uint8_t)(1 + nextRandom(rng) % 4) : 0;
+                if (!rollbackShouldHold(s)) advanceRollback(s, key, dt);
+                // Final states: saved, and every key before them confirmed
+                uint32_t final = std::min(s.confirmedTick + 1, s.tick);
+                for (uint32_t t = (uint32_t)checksums[i].size(); t < final && t + ROLLBACK_WINDOW > s.tick; t++) {
+                    checksums[i].push_back(fnv1a(&s.states[t % ROLLBACK_WINDOW], sizeof(GameImage)));
+                }
+            }
+            DelayedPacket out;
+            out.to = 1 - i;
+            out.size = encodePeerPacket(s, out.data);
+            out.due = now + latency + (latency ? nextRandom(rng) % (latency / 2 + 1) : 0);
+            sent++;
+            if (nextRandom(rng) % 20 == 0) lost++;
+            else inFlight.push_back(out);
+        }
+    }
+
+    size_t compared = std::min(checksums[0].size(), checksums[1].size());
+    size_t desynced = 0;
+    for (size_t t = 0; t < compared; t++) desynced += checksums[0][t] != checksums[1][t];
+
+    std::printf("%d ms latency (%d ticks), %llu packets, %llu lost\n", latencyMs, latency,
+                (unsigned long long)sent, (unsigned long long)lost);
+    for (int i = 0; i < ROLLBACK_PLAYERS; i++) {
+        const RollbackSession &s = peers[i];
+        std::printf("peer %d (player %d): %u ticks, %llu rollbacks, %.1f ticks deep on average (max %u), "
+                    "%.1f us per rollback (worst %.1f), %llu stalls, %llu holds, score %d\n",
+                    i + 1, s.localPlayer + 1, s.tick, (unsigned long long)s.rollbacks,
+                    s.rollbacks ? (double)s.resimulated / s.rollbacks : 0.0, s.deepest,
+                    s.rollbacks ? s.resimSeconds / s.rollbacks * 1e6 : 0.0, s.worstResimSeconds * 1e6,
+                    (unsigned long long)s.stalls, (unsigned long long)s.holds, totalScore(*s.world));
+    }
+    std::printf("%zu confirmed ticks compared, %zu differ\n", compared, desynced);
+
+    // Restore + 10-tick resimulation on its own, in a game being played
+    RollbackSession &s = peers[0];
+    startNewGame(*s.world, s.seed);
+    s.world->playerCount = ROLLBACK_PLAYERS;
+    s.idleTicks = 0;
+    for (int t = 0; t < 30; t++) {
+        s.keys[s.tick % ROLLBACK_INPUTS][s.localPlayer] = (uint8_t)(1 + t % 4);
+        simulateRollbackTick(s, s.tick++, dt);
+    }
+    bool playing = s.world->gameState == PLAYING;
+    std::vector<double> samples;
+    for (int run = 0; run < 2000; run++) {
+        s.rollbackFrom = s.tick - 10;
+        s.keys[s.rollbackFrom % ROLLBACK_INPUTS][s.remotePlayer] = (uint8_t)(1 + run % 4);
+        Clock::time_point start = Clock::now();
+        resimulate(s, dt);
+        samples.push_back(std::chrono::duration<double>(Clock::now() - start).count());
+    }
+    std::sort(samples.begin(), samples.end());
+    double median = samples[samples.size() / 2], p99 = samples[samples.size() * 99 / 100];
+    std::printf("10-tick rollback%s: median %.1f us, p99 %.1f us, max %.1f us (budget 1000)\n",
+                playing ? "" : " (game not in play!)", median * 1e6, p99 * 1e6, samples.back() * 1e6);
+
+    for (int i = 0; i < ROLLBACK_PLAYERS; i++) closeSocket(socks[i]);
+    delete[] peers;
+    return desynced || compared == 0 || p99 >= 1e-3 ? 2 : 0;
+}
+
+// ---------------------- Spectator ----------------------
+// --spectate PID opens a window on the game running with --spectators
+// in process PID
+// Joins at the latest keyframe, then applies records in order; absolute
+// cell values make replaying a record the keyframe already has harmless
+// Falling a whole ring behind, or a torn read, rejoins at the keyframe
+// Waits for the game's feed to appear and reattaches when it is restarted;
+// a feed left open by a game that died is dropped once the game's process
+// is found gone
+// Keys are ignored
+
+struct SpectatorView {
+    SpectatorMapping map;
+    bool synced;
+    uint32_t next; // next record wanted
+    uint8_t board[ROWS][COLS];
+    SpectatorState latest; // of the last applied record
+    uint64_t applied, resyncs;
+};
+
+bool readKeyframe(const SpectatorFeed &feed, uint32_t &tick, uint8_t board[ROWS][COLS]) {
+    uint32_t seq = feed.keySeq.load(std::memory_order_acquire);
+    if (seq == 0) return false;
+    tick = feed.keyTick.load(std::memory_order_relaxed);
+    loadWords(board, feed.keyBoard, BOARD_WORDS);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return feed.keySeq.load(std::memory_order_relaxed) == seq && seq == tick + 1;
+}
+
+// Copies record tick out of the ring; false if overwritten or unwritten
+bool readSpectatorTick(const SpectatorFeed &feed, uint32_t tick, SpectatorState &out) {
+    const SpectatorTick &slot = feed.ticks[tick % SPECTATOR_TICKS];
+    if (slot.seq.load(std::memory_order_acquire) != tick + 1) return false;
+    loadWords(&out, slot.state, STATE_WORDS);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.seq.load(std::memory_order_relaxed) == tick + 1;
+}
+
+bool resyncSpectator(SpectatorView &view) {
+    const SpectatorFeed &feed = *view.map.feed;
+    uint32_t tick;
+    if (!readKeyframe(feed, tick, view.board)) return false;
+    if (view.synced || view.applied) view.resyncs++;
+    view.next = tick;
+    view.synced = true;
+    return true;
+}
+
+// Applies up to limit records published since the last call; returns how many
+int followFeed(SpectatorView &view, int limit) {
+    const SpectatorFeed &feed = *view.map.feed;
+    if (!view.synced && !resyncSpectator(view)) return 0;
+    int count = 0;
+    uint32_t head = feed.head.load(std::memory_order_acquire);
+    while (view.next < head && count < limit) {
+        SpectatorState record;
+        if (head - view.next >= SPECTATOR_TICKS - 1 || !readSpectatorTick(feed, view.next, record)) {
+            view.synced = false; // lapped by the writer
+            if (!resyncSpectator(view)) break;
+            continue;
+        }
+        if (record.changeCount == FULL_BOARD) {
+            uint32_t keyTick;
+            uint8_t board[ROWS][COLS];
+            if (!readKeyframe(feed, keyTick, board)) break;
+            if (keyTick != view.next) { // moved on already
+                view.synced = false;
+                if (!resyncSpectator(view)) break;
+                continue;
+            }
+            std::memcpy(view.board, board, sizeof(board));
+        } else {
+            uint8_t *cells = &view.board[0][0];
+            for (int i = 0; i < record.changeCount; i++) cells[record.changes[i] >> 2] = record.changes[i] & 3;
+        }
+        view.latest = record;
+        view.next++;
+        view.applied++;
+        count++;
+    }
+    return count;
+}
+
+void publishSpectatorView(const SpectatorView &view) {
+    const SpectatorState &record = view.latest;
+    FrameSnapshot &snap = snapshots.writeSlot();
+    snap.gameState = record.gameState <= HIGHSCORE ? (GameState)record.gameState : MENU;
+    for (int i = 0; i < ROWS; i++)
+        for (int j = 0; j < COLS; j++)
+            snap.board[i][j] = view.board[i][j];
+    snap.playerCount = std::min((int)record.playerCount, MAX_PLAYERS);
+    snap.score = snap.lives = 0;
+    for (int p = 0; p < snap.playerCount; p++) {
+        PacmanView &pac = snap.pacmen[p];
+        pac.x = record.pacmen[p].x;
+        pac.y = record.pacmen[p].y;
+        pac.score = record.scores[p];
+        pac.lives = record.lives[p];
+        snap.score += pac.score;
+        snap.lives += pac.lives;
+    }
+    snap.ghostCount = std::min((int)record.ghostCount, MAX_GHOSTS);
+    for (int i = 0; i < snap.ghostCount; i++) {
+        GhostView &ghost = snap.ghosts[i];
+        ghost.x = record.ghosts[i].x; ghost.y = record.ghosts[i].y;
+        setGhostColor(ghost, i);
+    }
+    snap.activePowerUp = record.activePowerUp;
+    snap.gameTime = record.gameTime;
+    snap.inputsHandled = inputsHandled;
+    snapshots.publish();
+}
+
+// False once the game has closed the feed or its process is gone
+bool feedLive(const SpectatorFeed &feed) {
+    return feed.open.load(std::memory_order_acquire) && processAlive(feed.hostPid);
+}
+
+bool attachSpectator(SpectatorView &view, uint32_t hostPid) {
+    if (!mapSpectatorFeed(view.map, hostPid, false)) return false;
+    const SpectatorFeed &feed = *view.map.feed;
+    if (std::memcmp(feed.magic, "PACSPEC1", 8) != 0 || feed.version != SPECTATOR_VERSION ||
+        feed.capacity != SPECTATOR_TICKS || !feedLive(feed)) {
+        unmapSpectatorFeed(view.map);
+        return false;
+    }
+    view.synced = false;
+    view.applied = 0;
+    return true;
+}
+
+std::atomic<bool> spectating(false);
+std::thread spectatorThread;
+uint32_t spectatedPid = 0;
+
+void spectatorLoop() {
+    nameTraceThread("spectator");
+    SpectatorView *view = new SpectatorView();
+    while (spectating.load(std::memory_order_relaxed)) {
+        InputEvent event;
+        while (inputQueue.pop(event)) inputsHandled++;
+        if (!view->map.feed && !attachSpectator(*view, spectatedPid)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            continue;
+        }
+        if (followFeed(*view, SPECTATOR_TICKS) > 0) publishSpectatorView(*view);
+        else if (!feedLive(*view->map.feed)) unmapSpectatorFeed(view->map);
+        std::this_thread::sleep_for(std::chrono::milliseconds(4));
+    }
+    unmapSpectatorFeed(view->map);
+    delete view;
+}
+
+void startSpectating() {
+    publishSnapshot(); // the menu until the feed is found
+    spectating = true;
+    spectatorThread = std::thread(spectatorLoop);
+}
+
+void stopSpectating() {
+    spectating = false;
+    if (spectatorThread.joinable()) spectatorThread.join();
+}
+
+// ---------------------- Spectator Test ----------------------
+// Run with --spectator-test [SPECTATORS]; no window
+// Plays random games headless into the feed while each spectator thread
+// maps it on its own, as a separate process would, and follows it
+// Spectators step one record at a time and check every state they
+// rebuild against the game's own
+// Reports the game's cost of the feed write per tick with no spectators
+// and with all of them attached, which should match
+
+struct SpectatorTruth {
+    uint8_t board[ROWS][COLS];
+    ActorPosition pacmen[MAX_PLAYERS];
+    ActorPosition ghosts[MAX_GHOSTS];
+    int32_t scores[MAX_PLAYERS];
+    uint8_t gameState;
+};
+
+const uint32_t TRUTH_TICKS = 8192; // the game's own states, by tick % this
+
+struct SpectatorCheck {
+    const std::vector<SpectatorTruth> *truth;
+    std::atomic<uint32_t> *written;
+    std::atomic<bool> *done;
+    uint64_t checked, mismatches, resyncs;
+};
+
+bool matchesTruth(const SpectatorView &view, const SpectatorTruth &truth) {
+    const SpectatorState &record = view.latest;
+    if (std::memcmp(view.board, truth.board, sizeof(truth.board)) != 0) return false;
+    if (record.gameState != truth.gameState) return false;
+    for (int p = 0; p < record.playerCount; p++) {
+        if (record.pacmen[p].x != truth.pacmen[p].x || record.pacmen[p].y != truth.pacmen[p].y) return false;
+        if (record.scores[p] != truth.scores[p]) return false;
+    }
+    for (int i = 0; i < record.ghostCount; i++) {
+        if (record.ghosts[i].x != truth.ghosts[i].x || record.ghosts[i].y != truth.ghosts[i].y) return false;
+    }
+    return true;
+}
+
+void checkSpectator(SpectatorCheck *check) {
+    SpectatorView *view = new SpectatorView();
+    while (!attachSpectator(*view, currentProcessId())) std::this_thread::yield();
+    while (true) {
+        bool finished = check->done->load(std::memory_order_acquire);
+        while (followFeed(*view, 1) > 0) {
+            uint32_t tick = view->next - 1;
+            // The game publishes the truth just after the record
+            while (check->written->load(std::memory_order_acquire) <= tick) std::this_thread::yield();
+            SpectatorTruth truth = (*check->truth)[tick % TRUTH_TICKS];
+            if (check->written->load(std::memory_order_acquire) >= tick + TRUTH_TICKS) continue; // reused meanwhile
+            check->checked++;
+            if (!matchesTruth(*view, truth)) check->mismatches++;
+        }
+        if (finished && view->next >= view->map.feed->head.load()) break;
+        std::this_thread::yield();
+    }
+    check->resyncs = view->resyncs;
+    unmapSpectatorFeed(view->map);
+    delete view;
+}
+
+// Mean cost of the Clock::now() pair around each timed write
+double clockOverheadSeconds() {
+    const int PAIRS = 10000;
+    double seconds = 0;
+    for (int i = 0; i < PAIRS; i++) {
+        Clock::time_point start = Clock::now();
+        seconds += std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    return seconds / PAIRS;
+}
+
+// Plays random games for ticks ticks; returns the mean ns per feed write
+double runSpectatedGame(World &w, uint32_t ticks, std::vector<SpectatorTruth> &truth, std::atomic<uint32_t> &written) {
+    const Fixed dt = tickFixed();
+    const double overhead = clockOverheadSeconds();
+    double seconds = 0;
+    for (uint32_t t = 0; t < ticks; t++) {
+        if (w.gameState != PLAYING) {
+            w.playerCount = MAX_PLAYERS;
+            startNewGame(w);
+        }
+        if (t % 20 == 0) {
+            const int *d = TURN_DIRS[rand() % 4];
+            queueTurn(w, rand() % w.playerCount, d[0], d[1], Clock::now());
+        }
+        updateGame(w, dt);
+        Clock::time_point start = Clock::now();
+        writeSpectatorTick(w);
+        seconds += std::chrono::duration<double>(Clock::now() - start).count();
+
+        SpectatorTruth &state = truth[(spectatorWriter.tick - 1) % TRUTH_TICKS];
+        for (int i = 0; i < ROWS; i++)
+            for (int j = 0; j < COLS; j++)
+                state.board[i][j] = (uint8_t)w.board[i][j];
+        each<Position, PlayerStats>(w.pacmen, 0, w.playerCount, [&](size_t p, const Position &pos, const PlayerStats &stats) {
+            state.pacmen[p].x = fixedToFloat(pos.x);
+            state.pacmen[p].y = fixedToFloat(pos.y);
+            state.scores[p] = stats.score;
+        });
+        each<Position>(w.ghosts, 0, std::min(w.ghosts.size(), (size_t)MAX_GHOSTS), [&](size_t i, const Position &pos) {
+            state.ghosts[i].x = fixedToFloat(pos.x);
+            state.ghosts[i].y = fixedToFloat(pos.y);
+        });
+        state.gameState = (uint8_t)w.gameState;
+        written.store(spectatorWriter.tick, std::memory_order_release);
+        if (t % 16 == 0) std::this_thread::yield(); // let spectators keep up on one core
+    }
+    return (seconds / ticks - overhead) * 1e9;
+}
+
+int runSpectatorTest(int spectators) {
+    const uint32_t TICKS = 200000;
+    spectators = std::max(1, spectators);
+    persistScores = false;
+    if (!startSpectatorFeed()) return 1;
+
+    World w; // not live: nothing logged or recorded
+    resetGame(w);
+    std::vector<SpectatorTruth> truth(TRUTH_TICKS);
+    std::atomic<uint32_t> written(0);
+    std::atomic<bool> done(false);
+    double alone = runSpectatedGame(w, TICKS, truth, written);
+
+    std::vector<SpectatorCheck> checks(spectators);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < spectators; i++) {
+        SpectatorCheck check = { &truth, &written, &done, 0, 0, 0 };
+        checks[i] = check;
+        threads.push_back(std::thread(checkSpectator, &checks[i]));
+    }
+    double watched = runSpectatedGame(w, TICKS, truth, written);
+    done = true;
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+    stopSpectatorFeed();
+
+    uint64_t checked = 0, mismatches = 0, resyncs = 0;
+    for (int i = 0; i < spectators; i++) {
+        checked += checks[i].checked;
+        mismatches += checks[i].mismatches;
+        resyncs += checks[i].resyncs;
+    }
+    std::printf("feed write per tick: %.1f ns alone, %.1f ns with %d spectators\n", alone, watched, spectators);
+    std::printf("%llu spectator states checked, %llu wrong, %llu rejoins at a keyframe\n",
+                (unsigned long long)checked, (unsigned long long)mismatches, (unsigned long long)resyncs);
+    return mismatches || checked == 0 ? 2 : 0;
+}
+
+// ---------------------- Lockstep ----------------------
+// --lockstep PLAYER HOST:PORT,HOST:PORT,... plays up to MAX_PLAYERS
+// peers in lockstep: entry PLAYER of the list is this peer's own port,
+// every peer sends the others only its key for each tick, nothing else
+// A key pressed on tick t applies on tick t + net.input_delay, so while
+// the others' keys are in flight the game keeps moving; a tick runs only
+// once every player's key for it is known, so no peer ever guesses
+// Every LOCKSTEP_HASH_EVERY ticks each peer hashes its whole GameImage and
+// sends the hash along; the first one that differs from ours is a desync,
+// reported with the tick it was found on
+// Player 1 picks the seed and sends it, with a hash of the gameplay
+// settings, to everyone else until they answer; games restart 3 s after
+// one ends, seeded from the game's own RNG, as with rollback
+// Keys are resent until acknowledged; ticks travel as 16 bits and are
+// widened again against what the receiver already has
+// While stalled, a resend goes only to peers still missing our keys or
+// hash, or that resent keys of their own and so missed our ack
+// Input packet: one byte of type, player and a hash-attached bit, then
+// ack, first tick, count, the keys at 4 bits each and, when attached,
+// a 16-bit tick and its hash
+
+const int LOCKSTEP_RING = 256;       // keys kept per player, in ticks
+const int LOCKSTEP_HASH_EVERY = 8;   // ticks between state hashes
+const int LOCKSTEP_HASHES = 32;      // hashes kept per player
+const int LOCKSTEP_HASH_REPEATS = 2; // packets each new hash rides on
+const int LOCKSTEP_RESEND_MS = 20;    // while waiting on the others
+const int LOCKSTEP_HEADER = 6;
+const int LOCKSTEP_HELLO_SIZE = 11;
+const unsigned char LOCKSTEP_TYPE_MASK = 0x1F;
+const int LOCKSTEP_PLAYER_SHIFT = 5;   // two bits of player
+const unsigned char LOCKSTEP_HASH_FLAG = 0x80;
+static_assert(MAX_PLAYERS <= 4 && PKT_LOCKSTEP <= LOCKSTEP_TYPE_MASK, "lockstep packs type and player in one byte");
+const uint32_t NO_HASH = 0xFFFFFFFFu;
+
+struct LockstepPeer {
+    sockaddr_in addr;
+    bool started;      // has sent us keys, so knows the seed
+    uint32_t received; // its keys are known for ticks below this
+    uint32_t acked;    // it has our keys for ticks below this
+    int hashRepeats;   // packets left that carry our latest hash
+    bool ackDue;       // it sent keys since our last packet to it
+    uint32_t hashTicks[LOCKSTEP_HASHES], hashes[LOCKSTEP_HASHES];
+};
+
+struct LockstepSession {
+    World *world;
+    int player, players;
+    uint32_t seed, settingsHash;
+    bool started, desynced;
+    uint32_t tick;       // next tick to simulate
+    uint32_t produced;   // our keys exist for ticks below this
+    uint32_t idleTicks;  // ticks since the game stopped playing
+    uint8_t keys[LOCKSTEP_RING][MAX_PLAYERS];
+    uint32_t hashTicks[LOCKSTEP_HASHES], hashes[LOCKSTEP_HASHES];
+    uint32_t lastHashTick, desyncTick, desyncFoundAt;
+    int desyncPlayer;
+    LockstepPeer peers[MAX_PLAYERS];
+    uint64_t bytesSent, packetsSent, stalls, hashesCompared;
+};
+
+// Everything that steers the simulation; window size and rates do not
+uint32_t gameplaySettingsHash() {
+    return fnv1a(&settings, offsetof(Settings, renderHz));
+}
+
+inline void putU16(unsigned char *out, uint16_t value) {
+    out[0] = (unsigned char)value;
+    out[1] = (unsigned char)(value >> 8);
+}
+
+inline uint16_t getU16(const unsigned char *in) {
+    return (uint16_t)(in[0] | in[1] << 8);
+}
+
+// The full tick nearest to near whose low 16 bits are wire
+inline uint32_t widenTick(uint32_t near, uint16_t wire) {
+    return near + (int16_t)(wire - (uint16_t)near);
+}
+
+void openLockstep(LockstepSession &s, World &w, int player, const std::vector<sockaddr_in> &addrs) {
+    std::memset(&s, 0, sizeof(s));
+    s.world = &w;
+    s.player = player;
+    s.players = (int)addrs.size();
+    s.settingsHash = gameplaySettingsHash();
+    s.produced = settings.inputDelay; // nobody presses anything before that
+    s.desyncPlayer = -1;
+    for (int p = 0; p < s.players; p++) s.peers[p].addr = addrs[p];
+    for (int i = 0; i < LOCKSTEP_HASHES; i++) s.hashTicks[i] = NO_HASH;
+    for (int p = 0; p < MAX_PLAYERS; p++) {
+        for (int i = 0; i < LOCKSTEP_HASHES; i++) s.peers[p].hashTicks[i] = NO_HASH;
+    }
+    resetGame(w);
+}
+
+void beginLockstep(LockstepSession &s, uint32_t seed) {
+    s.seed = seed;
+    s.started = true;
+    s.world->playerCount = s.players;
+    startNewGame(*s.world, seed);
+}
+
+// True once every player's key for the next tick is here
+bool lockstepReady(const LockstepSession &s) {
+    if (!s.started) return false;
+    for (int p = 0; p < s.players; p++) {
+        if (p != s.player && s.peers[p].received <= s.tick) return false;
+    }
+    return true;
+}
+
+void compareHash(LockstepSession &s, int player, uint32_t tick, uint32_t theirs) {
+    int slot = (tick / LOCKSTEP_HASH_EVERY) % LOCKSTEP_HASHES;
+    if (s.hashTicks[slot] != tick) return;
+    s.hashesCompared++;
+    if (s.hashes[slot] == theirs || s.desynced) return;
+    s.desynced = true;
+    s.desyncTick = tick;
+    s.desyncFoundAt = s.tick;
+    s.desyncPlayer = player;
+}
+
+// Runs the next tick with everyone's keys and queues the local key for
+// tick + delay; callers check lockstepReady() first
+void stepLockstep(LockstepSession &s, uint8_t localKey, Fixed dt) {
+    World &w = *s.world;
+    s.keys[s.produced % LOCKSTEP_RING][s.player] = localKey;
+    s.produced++;
+
+    if (w.gameState != PLAYING && ++s.idleTicks >= (uint32_t)(NET_RESTART_SECONDS * settings.simHz)) {
+        w.playerCount = s.players;
+        startNewGame(w, nextRandom(w.gameRng));
+    }
+    if (w.gameState == PLAYING) s.idleTicks = 0;
+    const uint8_t *keys = s.keys[s.tick % LOCKSTEP_RING];
+    for (int p = 0; p < s.players; p++) {
+        if (keys[p] && w.gameState == PLAYING) {
+            queueTurn(w, p, TURN_DIRS[keys[p] - 1][0], TURN_DIRS[keys[p] - 1][1], Clock::time_point());
+        }
+    }
+    updateGame(w, dt);
+    s.tick++;
+
+    if (s.tick % LOCKSTEP_HASH_EVERY == 0) {
+        TRACE_SCOPE("lockstep hash");
+        GameImage image;
+        captureGameImage(w, image);
+        int slot = (s.tick / LOCKSTEP_HASH_EVERY) % LOCKSTEP_HASHES;
+        s.hashTicks[slot] = s.tick;
+        s.hashes[slot] = fnv1a(&image, sizeof(image));
+        s.lastHashTick = s.tick;
+        for (int p = 0; p < s.players; p++) {
+            LockstepPeer &peer = s.peers[p];
+            peer.hashRepeats = LOCKSTEP_HASH_REPEATS;
+            if (p != s.player && peer.hashTicks[slot] == s.tick) compareHash(s, p, s.tick, peer.hashes[slot]);
+        }
+    }
+}
+
+size_t encodeLockstepHello(const LockstepSession &s, unsigned char *out) {
+    out[0] = PKT_LOCKSTEP_HELLO;
+    out[1] = (unsigned char)s.player;
+    out[2] = (unsigned char)s.players;
+    putU32(out + 3, s.seed);
+    putU32(out + 7, s.settingsHash);
+    return LOCKSTEP_HELLO_SIZE;
+}
+
+size_t encodeLockstepInput(LockstepSession &s, int to, unsigned char *out) {
+    LockstepPeer &peer = s.peers[to];
+    uint32_t first = std::max(peer.acked, s.produced > (uint32_t)LOCKSTEP_RING ? s.produced - LOCKSTEP_RING : 0u);
+    uint32_t count = std::min(s.produced - first, 255u);
+    bool withHash = peer.hashRepeats > 0 && s.lastHashTick > 0;
+    peer.ackDue = false;
+
+    out[0] = (unsigned char)(PKT_LOCKSTEP | s.player << LOCKSTEP_PLAYER_SHIFT | (withHash ? LOCKSTEP_HASH_FLAG : 0));
+    putU16(out + 1, (uint16_t)peer.received);
+    putU16(out + 3, (uint16_t)first);
+    out[5] = (unsigned char)count;
+    size_t size = LOCKSTEP_HEADER;
+    for (uint32_t i = 0; i < count; i += 2) {
+        uint8_t low = s.keys[(first + i) % LOCKSTEP_RING][s.player];
+        uint8_t high = i + 1 < count ? s.keys[(first + i + 1) % LOCKSTEP_RING][s.player] : 0;
+        out[size++] = (unsigned char)(low | high << 4);
+    }
+    if (withHash) {
+        int slot = (s.lastHashTick / LOCKSTEP_HASH_EVERY) % LOCKSTEP_HASHES;
+        putU16(out + size, (uint16_t)s.lastHashTick);
+        putU32(out + size + 2, s.hashes[slot]);
+        size += 6;
+        peer.hashRepeats--;
+    }
+    return size;
+}
+
+void handleLockstepPacket(LockstepSession &s, const unsigned char *data, int size, const sockaddr_in &from) {
+    if (size < LOCKSTEP_HEADER) return;
+    bool hello = data[0] == PKT_LOCKSTEP_HELLO;
+    int player = hello ? data[1] : (data[0] >> LOCKSTEP_PLAYER_SHIFT) & 3;
+    if (player >= s.players || player == s.player || !sameAddress(from, s.peers[player].addr)) return;
+    LockstepPeer &peer = s.peers[player];
+
+    if (hello) {
+        if (size < LOCKSTEP_HELLO_SIZE || player != 0 || s.started) return;
+        if (data[2] != s.players || getU32(data + 7) != s.settingsHash) {
+            std::cerr << "Lockstep peer 1 has " << (int)data[2] << " players or different settings; "
+                      << "every peer needs the same player list and gameplay settings" << std::endl;
+            return;
+        }
+        beginLockstep(s, getU32(data + 3));
+        return;
+    }
+    if ((data[0] & LOCKSTEP_TYPE_MASK) != PKT_LOCKSTEP) return;
+    bool withHash = (data[0] & LOCKSTEP_HASH_FLAG) != 0;
+    uint32_t count = data[5];
+    if ((int)(LOCKSTEP_HEADER + (count + 1) / 2 + (withHash ? 6 : 0)) > size) return;
+    peer.started = true;
+    if (count) peer.ackDue = true;
+
+    uint32_t ack = widenTick(peer.acked, getU16(data + 1));
+    if (ack > peer.acked && ack <= s.produced) peer.acked = ack;
+    uint32_t first = widenTick(peer.received, getU16(data + 3));
+    if (first <= peer.received) { // otherwise a gap; wait for a resend
+        for (uint32_t t = peer.received; t < first + count; t++) {
+            uint32_t i = t - first;
+            uint8_t code = (data[LOCKSTEP_HEADER + i / 2] >> (i % 2 * 4)) & 0xF;
+            s.keys[t % LOCKSTEP_RING][player] = code > 4 ? 0 : code;
+        }
+        peer.received = std::max(peer.received, first + count);
+    }
+    if (withHash) {
+        const unsigned char *hash = data + LOCKSTEP_HEADER + (count + 1) / 2;
+        uint32_t tick = widenTick(s.tick, getU16(hash));
+        int slot = (tick / LOCKSTEP_HASH_EVERY) % LOCKSTEP_HASHES;
+        if (tick % LOCKSTEP_HASH_EVERY || peer.hashTicks[slot] == tick) return; // a repeat
+        peer.hashTicks[slot] = tick;
+        peer.hashes[slot] = getU32(hash + 2);
+        compareHash(s, player, tick, peer.hashes[slot]);
+    }
+}
+
+void receiveLockstep(LockstepSession &s, NetSocket sock) {
+    unsigned char packet[MAX_PACKET];
+    sockaddr_in from;
+    while (int size = receivePacket(sock, packet, from)) handleLockstepPacket(s, packet, size, from);
+}
+
+// True when the peer is missing something a resend would carry
+bool lockstepOutstanding(const LockstepSession &s, const LockstepPeer &peer) {
+    return peer.acked < s.produced || (peer.hashRepeats > 0 && s.lastHashTick > 0) || peer.ackDue;
+}
+
+// Keys (and the seed, from player 1) to every other peer, or with resend
+// only to those with something outstanding; lossPercent drops that share
+// of packets on purpose, for the loopback test
+void sendLockstep(LockstepSession &s, NetSocket sock, bool resend, unsigned int *lossRng = 0, int lossPercent = 0) {
+    unsigned char packet[MAX_PACKET];
+    for (int p = 0; p < s.players; p++) {
+        if (p == s.player) continue;
+        size_t size = 0;
+        if (s.player == 0 && s.started && !s.peers[p].started) {
+            size = encodeLockstepHello(s, packet);
+            s.bytesSent += size;
+            if (!lossRng || (int)(nextRandom(*lossRng) % 100) >= lossPercent) sendPacket(sock, s.peers[p].addr, packet, size);
+        }
+        if (!s.started || (resend && !lockstepOutstanding(s, s.peers[p]))) continue;
+        size = encodeLockstepInput(s, p, packet);
+        s.bytesSent += size;
+        s.packetsSent++;
+        if (lossRng && (int)(nextRandom(*lossRng) % 100) < lossPercent) continue;
+        sendPacket(sock, s.peers[p].addr, packet, size);
+    }
+}
+
+// "HOST:PORT,HOST:PORT,..." into one address per player
+bool parsePeerList(const std::string &list, std::vector<sockaddr_in> &addrs) {
+    std::stringstream in(list);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        sockaddr_in addr;
+        if (!resolveAddress(item, addr)) {
+            std::cerr << "Cannot resolve lockstep peer " << item << std::endl;
+            return false;
+        }
+        addrs.push_back(addr);
+    }
+    if (addrs.size() < 2 || addrs.size() > (size_t)MAX_PLAYERS) {
+        std::cerr << "Lockstep needs 2 to " << MAX_PLAYERS << " peers, got " << addrs.size() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+LockstepSession lockstepSession;
+NetSocket lockstepSocket = NO_SOCKET;
+std::atomic<bool> lockstepRunning(false);
+std::thread lockstepThread;
+
+void lockstepLoop() {
+    nameTraceThread("lockstep");
+    LockstepSession &s = lockstepSession;
+    const Clock::duration tick = tickDuration();
+    const Fixed dt = tickFixed();
+    Clock::time_point next = Clock::now(), lastSend;
+    uint8_t localKey = 0;
+    bool reported = false;
+
+    while (lockstepRunning.load(std::memory_order_relaxed)) {
+        receiveLockstep(s, lockstepSocket);
+        InputEvent event;
+        while (inputQueue.pop(event)) {
+            if (uint8_t code = turnKeyCode(event.key)) localKey = code;
+            inputsHandled++;
+        }
+        if (s.desynced && !reported) {
+            std::cerr << "Lockstep desync with player " << s.desyncPlayer + 1 << " at tick " << s.desyncTick
+                      << " (found on tick " << s.desyncFoundAt << ")" << std::endl;
+            reported = true;
+        }
+
+        Clock::time_point now = Clock::now();
+        if (now >= next && lockstepReady(s)) {
+            stepLockstep(s, localKey, dt);
+            localKey = 0;
+            writeSpectatorTick(game);
+            sendLockstep(s, lockstepSocket, false);
+            lastSend = now;
+            publishSnapshot();
+            next += tick;
+            if (now - next > std::chrono::milliseconds(250)) next = now;
+            continue;
+        }
+        if (now >= next) {
+            // Waiting on someone's keys; resend ours in case they were lost
+            s.stalls++;
+            next = now + tick;
+        }
+        if (now - lastSend > std::chrono::milliseconds(LOCKSTEP_RESEND_MS)) {
+            sendLockstep(s, lockstepSocket, true);
+            lastSend = now;
+        }
+        waitForPacket(lockstepSocket, (long)std::chrono::duration_cast<std::chrono::microseconds>(next - now).count());
+    }
+    closeSocket(lockstepSocket);
+}
+
+void startLockstep(int player, const std::string &list) {
+    std::vector<sockaddr_in> addrs;
+    if (!startNetworking() || !parsePeerList(list, addrs)) return;
+    if (player < 0 || player >= (int)addrs.size()) {
+        std::cerr << "Lockstep player must be 1 to " << addrs.size() << std::endl;
+        return;
+    }
+    lockstepSocket = openUdpSocket(ntohs(addrs[player].sin_port));
+    if (lockstepSocket == NO_SOCKET) {
+        std::cerr << "Cannot open UDP port " << ntohs(addrs[player].sin_port) << std::endl;
+        return;
+    }
+    openLockstep(lockstepSession, game, player, addrs);
+    if (player == 0) beginLockstep(lockstepSession, ((uint32_t)rand() ^ (uint32_t)Clock::now().time_since_epoch().count()));
+    publishSnapshot();
+    lockstepRunning = true;
+    lockstepThread = std::thread(lockstepLoop);
+}
+
+void stopLockstep() {
+    lockstepRunning = false;
+    if (lockstepThread.joinable()) lockstepThread.join();
+}
+
+// ---------------------- Lockstep Test ----------------------
+// Run with --lockstep-test [PLAYERS]; no window
+// Starts PLAYERS - 1 copies of this program as --lockstep-bot peers and
+// plays the last one itself, all over 127.0.0.1 with random keys, 5% of
+// packets dropped on purpose and no waiting for real time between ticks
+// The current settings go to the copies through a config file in the
+// temp directory, named after this process and removed afterwards
+// First run: a minute of game time that must end with no desync
+// Second run: the last player bumps its own score on one tick; every
+// peer must notice on the next hash it compares and exit with code 2
+// Each peer prints the bytes it sent per tick to each other peer
+
+const int LOCKSTEP_TEST_LOSS = 5;        // percent
+const int LOCKSTEP_STUCK_SECONDS = 5;    // no new tick for this long ends a bot
+const int UDP_HEADER_BYTES = 28;         // IPv4 + UDP, on top of every payload
+
+std::string tempFilePath(const std::string &name) {
+#ifdef _WIN32
+    char dir[MAX_PATH + 1];
+    DWORD length = GetTempPathA(sizeof(dir), dir);
+    return (length > 0 && length < sizeof(dir) ? std::string(dir) : std::string(".\\")) + name;
+#else
+    const char *dir = std::getenv("TMPDIR");
+    return std::string(dir && *dir ? dir : "/tmp") + "/" + name;
+#endif
+}
+
+// --lockstep-bot PLAYER LIST TICKS DESYNC_TICK LOSS_PERCENT: 0 when the
+// run finished in sync, 2 on a desync, 3 when the others went quiet
+int runLockstepBot(int player, const std::string &list, uint32_t ticks, uint32_t desyncAt, int lossPercent) {
+    persistScores = false;
+    std::vector<sockaddr_in> addrs;
+    if (!startNetworking() || !parsePeerList(list, addrs)) return 1;
+    if (player < 0 || player >= (int)addrs.size()) return 1;
+    NetSocket sock = openUdpSocket(ntohs(addrs[player].sin_port));
+    if (sock == NO_SOCKET) {
+        std::cerr << "Cannot open UDP port " << ntohs(addrs[player].sin_port) << std::endl;
+        return 1;
+    }
+
+    World *w = new World;
+    LockstepSession *session = new LockstepSession;
+    LockstepSession &s = *session;
+    w->live = false;
+    openLockstep(s, *w, player, addrs);
+    if (player == 0) beginLockstep(s, ((uint32_t)rand() ^ (uint32_t)Clock::now().time_since_epoch().count()));
+
+    const Fixed dt = tickFixed();
+    unsigned int keyRng = 1000u + 7919u * player, lossRng = 31u + player;
+    Clock::time_point start = Clock::now(), lastTick = start, lastSend = start;
+    uint32_t stalledOn = NO_HASH;
+    bool stuck = false;
+    while (s.tick < ticks && !s.desynced) {
+        receiveLockstep(s, sock);
+        Clock::time_point now = Clock::now();
+        if (lockstepReady(s)) {
+            uint8_t key = nextRandom(keyRng) % 8 == 0 ? (uint8_t)(1 + nextRandom(keyRng) % 4) : 0;
+            stepLockstep(s, key, dt);
+            if (s.tick == desyncAt) w->pacmen.get<PlayerStats>(player).score++; // the injected desync
+            sendLockstep(s, sock, false, &lossRng, lossPercent);
+            lastTick = lastSend = now;
+            continue;
+        }
+        if (stalledOn != s.tick) {
+            s.stalls++;
+            stalledOn = s.tick;
+        }
+        if (now - lastTick > std::chrono::seconds(LOCKSTEP_STUCK_SECONDS)) {
+            stuck = true;
+            break;
+        }
+        if (now - lastSend > std::chrono::milliseconds(LOCKSTEP_RESEND_MS)) {
+            sendLockstep(s, sock, true, &lossRng, lossPercent);
+            lastSend = now;
+        }
+        waitForPacket(sock, LOCKSTEP_RESEND_MS * 1000);
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    uint64_t bytes = s.bytesSent, packets = s.packetsSent;
+
+    // Stay a little so the others get our last keys and hashes
+    Clock::time_point lingerEnd = Clock::now() + std::chrono::milliseconds(s.desynced ? 500 : 1000);
+    while (!stuck && Clock::now() < lingerEnd) {
+        bool delivered = true;
+        for (int p = 0; p < s.players; p++) delivered &= p == s.player || s.peers[p].acked >= ticks;
+        if (delivered && !s.desynced) break;
+        receiveLockstep(s, sock);
+        sendLockstep(s, sock, true, &lossRng, lossPercent);
+        waitForPacket(sock, LOCKSTEP_RESEND_MS * 1000);
+    }
+    closeSocket(sock);
+
+    int links = s.players - 1;
+    std::printf("player %d: %u ticks in %.2f s, %.1f bytes per tick to each peer (%.1f per packet, +%d UDP/IP), "
+                "%llu stalls, %llu hashes compared, score %d", player + 1, s.tick, seconds,
+                s.tick ? (double)bytes / s.tick / links : 0.0, packets ? (double)bytes / packets : 0.0,
+                UDP_HEADER_BYTES, (unsigned long long)s.stalls, (unsigned long long)s.hashesCompared,
+                totalScore(*w));
+    if (s.desynced) {
+        std::printf(", DESYNC with player %d at tick %u, found on tick %u", s.desyncPlayer + 1, s.desyncTick,
+                    s.desyncFoundAt);
+    }
+    if (stuck) std::printf(", stuck waiting for keys");
+    std::printf("\n");
+    std::fflush(stdout);
+    int result = s.desynced ? 2 : stuck ? 3 : 0;
+    delete session;
+    delete w;
+    return result;
+}
+
+#ifdef _WIN32
+typedef HANDLE ChildProcess;
+#else
+typedef pid_t ChildProcess;
+#endif
+
+const char *programPath = "";
+
+// Starts this program again with the given arguments
+bool spawnSelf(const std::vector<std::string> &args, ChildProcess &child) {
+    std::fflush(stdout); // or a forked child would print it again
+#ifdef _WIN32
+    char path[MAX_PATH];
+    GetModuleFileNameA(0, path, MAX_PATH);
+    std::string command = std::string("\"") + path + "\"";
+    for (size_t i = 0; i < args.size(); i++) command += " \"" + args[i] + "\"";
+    STARTUPINFOA startup;
+    PROCESS_INFORMATION info;
+    std::memset(&startup, 0, sizeof(startup));
+    startup.cb = sizeof(startup);
+    if (!CreateProcessA(path, &command[0], 0, 0, FALSE, 0, 0, 0, &startup, &info)) return false;
+    CloseHandle(info.hThread);
+    child = info.hProcess;
+    return true;
+#else
+    std::vector<char *> argv;
+    argv.push_back((char *)programPath);
+    for (size_t i = 0; i < args.size(); i++) argv.push_back((char *)args[i].c_str());
+    argv.push_back(0);
+    child = fork();
+    if (child < 0) return false;
+    if (child == 0) {
+        execvp(programPath, &argv[0]);
+        _exit(127);
+    }
+    return true;
+#endif
+}
+
+// The child's exit code, -1 if it did not exit normally
+int waitForChild(ChildProcess child) {
+#ifdef _WIN32
+    DWORD code = (DWORD)-1;
+    WaitForSingleObject(child, INFINITE);
+    GetExitCodeProcess(child, &code);
+    CloseHandle(child);
+    return (int)code;
+#else
+    int status = 0;
+    if (waitpid(child, &status, 0) != child || !WIFEXITED(status)) return -1;
+    return WEXITSTATUS(status);
+#endif
+}
+
+// One run with every peer; true when each one exited with expected
+bool runLockstepRound(int players, uint16_t basePort, uint32_t ticks, uint32_t desyncAt, int expected,
+                      const std::string &configFile) {
+    std::string list;
+    for (int p = 0; p < players; p++) {
+        list += (p ? ",127.0.0.1:" : "127.0.0.1:") + intToString(basePort + p);
+    }
+    // The spawning peer is the last player, so player 1 (the seed) is a child
+    std::vector<ChildProcess> children;
+    for (int p = 0; p + 1 < players; p++) {
+        std::vector<std::string> args;
+        args.push_back("--config");
+        args.push_back(configFile);
+        args.push_back("--lockstep-bot");
+        args.push_back(intToString(p + 1));
+        args.push_back(list);
+        args.push_back(intToString(ticks));
+        args.push_back("0"); // only the spawning peer goes out of sync
+        args.push_back(intToString(LOCKSTEP_TEST_LOSS));
+        ChildProcess child;
+        if (!spawnSelf(args, child)) {
+            std::cerr << "Cannot start lockstep peer " << p + 1 << std::endl;
+            return false;
+        }
+        children.push_back(child);
+    }
+    bool ok = runLockstepBot(players - 1, list, ticks, desyncAt, LOCKSTEP_TEST_LOSS) == expected;
+    for (size_t i = 0; i < children.size(); i++) {
+        int code = waitForChild(children[i]);
+        if (code != expected) {
+            std::printf("peer %d exited with %d, expected %d\n", (int)i + 1, code, expected);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int runLockstepTest(int players) {
+    players = std::max(2, std::min(players, MAX_PLAYERS));
+    const uint32_t TICKS = 60 * settings.simHz;
+    const uint32_t DESYNC_AT = TICKS / 4 + 3;
+    const std::string configFile = tempFilePath("pacman-lockstep-" + intToString((int)currentProcessId()) + ".cfg");
+    FILE *out = std::fopen(configFile.c_str(), "w");
+    if (!out) {
+        std::cerr << "Cannot write " << configFile << std::endl;
+        return 1;
+    }
+    printSettings(out);
+    std::fclose(out);
+
+    uint16_t basePort = (uint16_t)(20000 + ((uint32_t)rand() ^ (uint32_t)Clock::now().time_since_epoch().count()) % 40000);
+    std::printf("%d peers, input delay %d ticks, hash every %d ticks, %d%% of packets dropped\n",
+                players, settings.inputDelay, LOCKSTEP_HASH_EVERY, LOCKSTEP_TEST_LOSS);
+    std::printf("-- %u ticks, no desync expected\n", TICKS);
+    bool clean = runLockstepRound(players, basePort, TICKS, 0, 0, configFile);
+    std::printf("-- desync injected on tick %u by player %d\n", DESYNC_AT, players);
+    bool caught = runLockstepRound(players, (uint16_t)(basePort + players), TICKS, DESYNC_AT, 2, configFile);
+    std::remove(configFile.c_str());
+
+    std::printf("in sync run: %s, desync run: %s\n", clean ? "passed" : "FAILED", caught ? "every peer caught it" : "FAILED");
+    return clean && caught ? 0 : 2;
+}
+
+// ---------------------- Main Entry Point ----------------------
+// Initializes random number generator for ghost AI
+// Sets up GLUT window and OpenGL context
+// Configures double buffering for smooth graphics
+// Creates 800x800 pixel window with title
+// Sets up 2D orthographic projection (0-20 range for game grid)
+// Loads the leaderboard and starts the background disk writer
+// Resets game to initial state
+// Starts the job system and simulation thread, stopped again at exit
+// --bench-jobs runs the job system benchmark instead of the game
+// --busy-idle keeps the loop running on static screens (for comparison)
+// --sim-hz N / --render-hz N set simulation and render rates separately
+// --bench-sim times updateGame() headless at the chosen sim rate;
+// --bench-entities [N] times it with up to N ghosts
+// --metrics-file PATH / --metrics-socket PATH export the metrics registry
+// --trace PATH writes a Chrome trace of frame phases at exit
+// --event-log PATH / --no-event-log choose where gameplay events go
+// --read-events FILE... summarizes event logs instead of playing; every
+// flag before it still applies
+// --save-file PATH picks the save game; --load PATH starts paused in a save
+// --server PORT hosts a headless multiplayer game; --client HOST:PORT
+// joins one and only renders; --net-test [N] checks both over loopback
+// --peer PORT HOST:PORT plays two players peer to peer with rollback;
+// --rollback-test [MS] checks it over loopback with simulated latency
+// --spectators lets local --spectate PID windows watch this game;
+// --spectator-test [N] checks the feed with N spectators
+// --lockstep PLAYER HOST:PORT,... plays up to four peers in lockstep,
+// --input-delay N ticks apart from key to move; --lockstep-test [N]
+// checks it with N local processes
+// Options apply wherever they appear; the commands above (tests, benches,
+// --server, --print-config) run once every option has been read
+// Registers callback functions:
+//   - display() for rendering
+//   - keyboard() for input
+//   - specialKey() for the F3 stats overlay
+//   - timer() for game loop
+// Starts GLUT main loop (runs until exit)
+
+int main(int argc, char** argv) {
+    srand(time(0));
+    programPath = argv[0];
+    eventLog.path = "events.bin";
+    bool eventLogRequested = false;
+    std::string loadPath;
+    std::string analyzeDir, analysisPrefix = "analysis";
+    std::string serverAddress, peerRemote, lockstepPeers;
+    int lockstepPlayer = 0;
+    uint16_t peerLocalPort = 0;
+    bool spectate = false, hostSpectators = false;
+
+    // Settings file first so any flag below can override it
+    std::string configPath = "pacman.cfg";
+    bool configRequested = false;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::string(argv[i]) == "--config") {
+            configPath = argv[i + 1];
+            configRequested = true;
+        }
+    }
+    bool configOk = loadSettings(configPath, configRequested);
+    configOk = checkSpawnPoints(configPath.c_str()) && configOk;
+    if (!configOk && configRequested) return 1;
+
+    // Options first, then the one command (last given wins) runs with all
+    // of them applied, wherever it sits on the command line
+    std::string command;
+    int commandAt = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--bench-jobs" || arg == "--print-config" || arg == "--read-events" ||
+            arg == "--rollback-test" || arg == "--lockstep-test" || arg == "--spectator-test" ||
+            arg == "--net-test" || arg == "--bench-sim" || arg == "--bench-entities" ||
+            (arg == "--server" && i + 1 < argc) || (arg == "--lockstep-bot" && i + 5 < argc)) {
+            command = arg;
+            commandAt = i + 1;
+            if (arg == "--read-events") break; // the rest are event files
+        } else if (arg == "--config" && i + 1 < argc) {
+            i++; // already loaded above
+        } else if (arg == "--busy-idle") {
+            eventDrivenIdle = false;
+        } else if (arg == "--sim-hz" && i + 1 < argc) {
+            applySetting("engine.sim_hz", argv[++i], "--sim-hz");
+        } else if (arg == "--render-hz" && i + 1 < argc) {
+            applySetting("engine.render_hz", argv[++i], "--render-hz");
+        } else if (arg == "--event-log" && i + 1 < argc) {
+            eventLog.path = argv[++i];
+            eventLogRequested = true;
+        } else if (arg == "--no-event-log") {
+            eventLog.path.clear();
+        } else if (arg == "--save-file" && i + 1 < argc) {
+            savePath = argv[++i];
+        } else if (arg == "--load" && i + 1 < argc) {
+            loadPath = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+            tracingEnabled = true;
+            traceStart = Clock::now();
+        } else if (arg == "--metrics-file" && i + 1 < argc) {
+            metricsExport.filePath = argv[++i];
+        } else if (arg == "--metrics-socket" && i + 1 < argc) {
+            metricsExport.socketPath = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            startRecording(argv[++i]);
+        } else if (arg == "--analyze" && i + 1 < argc) {
+            analyzeDir = argv[++i];
+        } else if (arg == "--analysis-out" && i + 1 < argc) {
+            analysisPrefix = argv[++i];
+        } else if (arg == "--client" && i + 1 < argc) {
+            serverAddress = argv[++i];
+        } else if (arg == "--peer" && i + 2 < argc) {
+            peerLocalPort = (uint16_t)std::atoi(argv[++i]);
+            peerRemote = argv[++i];
+        } else if (arg == "--lockstep" && i + 2 < argc) {
+            lockstepPlayer = std::atoi(argv[++i]) - 1;
+            lockstepPeers = argv[++i];
+        } else if (arg == "--input-delay" && i + 1 < argc) {
+            applySetting("net.input_delay", argv[++i], "--input-delay");
+        } else if (arg == "--spectators") {
+            hostSpectators = true;
+        } else if (arg == "--spectate" && i + 1 < argc) {
+            spectate = true;
+            spectatedPid = (uint32_t)std::atol(argv[++i]);
+        }
+    }
+
+    int k = commandAt;
+    int count = k < argc ? std::atoi(argv[k]) : 0;
+    if (command == "--bench-jobs") {
+        runJobBenchmark();
+        return 0;
+    } else if (command == "--print-config") {
+        printSettings(stdout);
+        return 0;
+    } else if (command == "--read-events") {
+        return runEventReader(argc, argv, k);
+    } else if (command == "--server") {
+        return runServer((uint16_t)std::atoi(argv[k]));
+    } else if (command == "--rollback-test") {
+        return runRollbackTest(k < argc ? count : 100);
+    } else if (command == "--lockstep-bot") {
+        return runLockstepBot(std::atoi(argv[k]) - 1, argv[k + 1], (uint32_t)std::atol(argv[k + 2]),
+                              (uint32_t)std::atol(argv[k + 3]), std::atoi(argv[k + 4]));
+    } else if (command == "--lockstep-test") {
+        return runLockstepTest(k < argc ? count : 4);
+    } else if (command == "--spectator-test") {
+        return runSpectatorTest(k < argc ? count : 4);
+    } else if (command == "--net-test") {
+        return runNetTest(k < argc ? count : 2);
+    } else if (command == "--bench-sim") {
+        eventLog.enabled = eventLogRequested;
+        return runSimBenchmark();
+    } else if (command == "--bench-entities") {
+        return runEntityBenchmark(k < argc ? count : 20000);
+    }
+    if (!analyzeDir.empty()) {
+        return runReplayAnalyzer(analyzeDir, analysisPrefix);
+    }
+
+    eventLog.enabled = !eventLog.path.empty();
+    glutInit(&argc, argv);
+    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+    glutInitWindowSize(settings.windowWidth, settings.windowHeight);
+    glutCreateWindow("Pacman Game - Complete Edition");
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluOrtho2D(0, COLS, 0, ROWS);
+
+    loadHighScore();
+    game.live = true;
+    resetGame(game);
+    if (!loadPath.empty() && loadGame(loadPath)) {
+        game.previousState = PAUSED;
+        game.gameState = PAUSED;
+        startReplay(game);
+    }
+    nameTraceThread("render");
+    atexit(writeTrace);
+    startDiskWriter();
+    atexit(stopDiskWriter);
+    startEventLog();
+    atexit(stopEventLog);
+    startJobSystem(defaultWorkerCount());
+    atexit(stopJobSystem);
+    if (hostSpectators && startSpectatorFeed()) {
+        std::cerr << "Spectators can join with --spectate " << currentProcessId() << std::endl;
+        atexit(stopSpectatorFeed);
+    }
+    if (spectate) {
+        eventDrivenIdle = false; // frames arrive from the feed
+        startSpectating();
+        atexit(stopSpectating);
+    } else if (!serverAddress.empty()) {
+        eventDrivenIdle = false; // frames arrive from the network
+        startNetClient(serverAddress);
+        atexit(stopNetClient);
+    } else if (!peerRemote.empty()) {
+        eventDrivenIdle = false;
+        startPeer(peerLocalPort, peerRemote);
+        atexit(stopPeer);
+    } else if (!lockstepPeers.empty()) {
+        eventDrivenIdle = false;
+        startLockstep(lockstepPlayer, lockstepPeers);
+        atexit(stopLockstep);
+    } else {
+        startSimulation();
+        atexit(stopSimulation);
+    }
+    startMetricsExport();
+    atexit(stopMetricsExport);
+
+    glutDisplayFunc(display);
+    glutKeyboardFunc(keyboard);
+    glutSpecialFunc(specialKey);
+    initFramePacer(settings.renderHz);
+    startRenderTimer();
+
+    glutMainLoop();
+    return 0;
+}